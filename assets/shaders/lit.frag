@@ -0,0 +1,15 @@
+#version 410 core
+
+layout(location = 0) in  vec3 v_Position;
+layout(location = 1) in  vec3 v_Normal;
+
+layout(location = 0) out vec4 f_Color;
+
+uniform vec3  u_Color;
+uniform vec3  u_LightDirection;
+uniform float u_Ambient;
+
+void main() {
+    float diffuse = max(dot(normalize(v_Normal), -u_LightDirection), 0.);
+    f_Color = vec4((u_Ambient + (1. - u_Ambient) * diffuse) * u_Color, 1.);
+}
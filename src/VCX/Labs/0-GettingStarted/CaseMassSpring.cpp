@@ -1,8 +1,15 @@
 #include "Engine/app.h"
 #include "Labs/0-GettingStarted/CaseMassSpring.h"
 #include "Labs/Common/ImGuiHelper.h"
+#include <array>
 
 namespace VCX::Labs::GettingStarted {
+    static constexpr auto c_LinearSolvers = std::array<char const *, 3> {
+        "Cholesky",
+        "CG Jacobi",
+        "CG Incomplete Cholesky",
+    };
+
     CaseMassSpring::CaseMassSpring():
         _program(
             Engine::GL::UniqueProgram({ Engine::GL::SharedShader("assets/shaders/flat.vert"),
@@ -23,6 +30,17 @@ namespace VCX::Labs::GettingStarted {
             ImGui::SliderFloat("Spr. Stiff.", &_massSpringSystem.Stiffness, 10.f, 300.f);
             ImGui::SliderFloat("Spr. Damp.", &_massSpringSystem.Damping, .1f, 10.f);
             ImGui::SliderFloat("Gravity", &_massSpringSystem.Gravity, .1f, 1.f);
+            int linearId = int(_massSpringSystem.Linear);
+            if (ImGui::Combo("Linear Solve", &linearId, c_LinearSolvers.data(), c_LinearSolvers.size()))
+                _massSpringSystem.Linear = MassSpringSystem::LinearSolver(linearId);
+            if (_massSpringSystem.Linear != MassSpringSystem::LinearSolver::Cholesky)
+                ImGui::SliderFloat("CG Tol.", &_massSpringSystem.CGTolerance, 1e-8f, 1e-2f, "%.1e", ImGuiSliderFlags_Logarithmic);
+            // the last solve of every solver that ran, for comparison
+            for (std::size_t k = 0; k < c_LinearSolvers.size(); k++) {
+                auto const & stats = _massSpringSystem.LastSolve[k];
+                if (stats.Seconds > 0)
+                    ImGui::Text("%s: %.3f ms, %d iters, res. %.1e", c_LinearSolvers[k], stats.Seconds * 1e3, stats.Iterations, stats.Error);
+            }
         }
         ImGui::Spacing();
 
@@ -75,7 +93,11 @@ namespace VCX::Labs::GettingStarted {
     }
 
     void CaseMassSpring::ResetSystem() {
-        _massSpringSystem       = {};
+        auto const  linear    = _massSpringSystem.Linear;
+        float const tolerance = _massSpringSystem.CGTolerance;
+        _massSpringSystem             = {};
+        _massSpringSystem.Linear      = linear;
+        _massSpringSystem.CGTolerance = tolerance;
         std::size_t const n     = 10;
         float const       delta = 2.f / n;
         auto constexpr GetID    = [](std::size_t const i, std::size_t const j) { return i * (n + 1) + j; };
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <Eigen/Dense>
+#include <Eigen/IterativeLinearSolvers>
 #include <Eigen/Sparse>
 #include <glm/glm.hpp>
 
@@ -23,6 +28,89 @@ namespace VCX::Labs::GettingStarted {
         float               Damping { .2f };
         float               Gravity { .3f };
 
+        // The velocities change little from frame to frame, so for large meshes conjugate gradients
+        // warm-started from them can replace the factorization. They stop when the relative residual
+        // drops below CGTolerance.
+        enum class LinearSolver {
+            Cholesky,             // numeric refactorization of the fixed pattern every step
+            CGJacobi,             // diagonal preconditioner
+            CGIncompleteCholesky, // incomplete Cholesky preconditioner, its ordering analyzed with the pattern
+        };
+
+        struct SolveStats {
+            double Seconds { 0 }; // factorization or preconditioner setup, and the solve
+            int    Iterations { 0 };
+            float  Error { 0 };   // relative residual
+        };
+
+        LinearSolver              Linear { LinearSolver::Cholesky };
+        float                     CGTolerance { 1e-5f };
+        int                       CGMaxIterations { 200 };
+        std::array<SolveStats, 3> LastSolve; // per LinearSolver, the direct and iterative solves side by side
+
+        using JacobiCGSolver             = Eigen::ConjugateGradient<Eigen::SparseMatrix<float>, Eigen::Lower | Eigen::Upper, Eigen::DiagonalPreconditioner<float>>;
+        using IncompleteCholeskyCGSolver = Eigen::ConjugateGradient<Eigen::SparseMatrix<float>, Eigen::Lower | Eigen::Upper, Eigen::IncompleteCholesky<float>>;
+
+        // The sparsity pattern of the linearized system only depends on the springs, so it is built and
+        // analyzed once. A step writes the nonzeros through the offsets below into the value array and
+        // runs the numeric factorization (or preconditioner setup) only. Springs with a fixed end write
+        // nothing, their entries stay explicit zeros. The solvers are held by pointer because Eigen
+        // solvers cannot be moved and the case resets the system by assignment.
+        Eigen::SparseMatrix<float>                                        MatLinearized;
+        std::unique_ptr<Eigen::SimplicialLLT<Eigen::SparseMatrix<float>>> Solver;
+        std::unique_ptr<JacobiCGSolver>                                   JacobiCG;
+        std::unique_ptr<IncompleteCholeskyCGSolver>                       IncompleteCholeskyCG;
+        std::vector<int>                                                  DiagonalNonZeros; // per DoF
+        std::vector<std::array<int, 12>>                                  SpringNonZeros;   // per spring: blocks 00, 01, 10, 11, three columns each
+
+        // offset of the entry (row, col) in the value array; the rows of a 3x3 block follow it
+        int nonzero_offset(int const row, int const col) const {
+            int const * const begin = MatLinearized.innerIndexPtr() + MatLinearized.outerIndexPtr()[col];
+            int const * const end   = MatLinearized.innerIndexPtr() + MatLinearized.outerIndexPtr()[col + 1];
+            return int(std::lower_bound(begin, end, row) - MatLinearized.innerIndexPtr());
+        }
+
+        void build_pattern() {
+            auto const                         nDoFs = int(Positions.size()) * 3;
+            std::vector<Eigen::Triplet<float>> coefficients;
+            for (int i = 0; i < nDoFs; i++) coefficients.emplace_back(i, i, 0.f);
+            for (auto const & spring : Springs) {
+                for (auto const p0 : { spring.AdjIdx.first, spring.AdjIdx.second })
+                    for (auto const p1 : { spring.AdjIdx.first, spring.AdjIdx.second })
+                        for (int i = 0; i < 3; i++)
+                            for (int j = 0; j < 3; j++) coefficients.emplace_back(int(p0) * 3 + i, int(p1) * 3 + j, 0.f);
+            }
+            MatLinearized.resize(nDoFs, nDoFs);
+            MatLinearized.setFromTriplets(coefficients.begin(), coefficients.end());
+
+            DiagonalNonZeros.resize(nDoFs);
+            for (int i = 0; i < nDoFs; i++) DiagonalNonZeros[i] = nonzero_offset(i, i);
+            SpringNonZeros.resize(Springs.size());
+            for (std::size_t s = 0; s < Springs.size(); s++) {
+                int const p[2] = { int(Springs[s].AdjIdx.first), int(Springs[s].AdjIdx.second) };
+                for (int b = 0; b < 4; b++)
+                    for (int j = 0; j < 3; j++) SpringNonZeros[s][b * 3 + j] = nonzero_offset(p[b / 2] * 3, p[b % 2] * 3 + j);
+            }
+
+            Solver = std::make_unique<Eigen::SimplicialLLT<Eigen::SparseMatrix<float>>>();
+            Solver->analyzePattern(MatLinearized);
+            JacobiCG = std::make_unique<JacobiCGSolver>();
+            JacobiCG->analyzePattern(MatLinearized);
+            IncompleteCholeskyCG = std::make_unique<IncompleteCholeskyCGSolver>();
+            IncompleteCholeskyCG->analyzePattern(MatLinearized);
+        }
+
+        // refreshes the preconditioner and solves from the guess in x
+        template<typename CG>
+        void solve_cg(CG & cg, Eigen::VectorXf const & rhs, Eigen::Ref<Eigen::VectorXf> x, SolveStats & stats) {
+            cg.setTolerance(CGTolerance);
+            cg.setMaxIterations(CGMaxIterations);
+            cg.factorize(MatLinearized);
+            x                = cg.solveWithGuess(rhs, x);
+            stats.Iterations = int(cg.iterations());
+            stats.Error      = float(cg.error());
+        }
+
         void AddParticle(glm::vec3 const & position, glm::vec3 const & velocity = glm::vec3(0)) {
             Positions.push_back(position);
             Velocities.push_back(velocity);
@@ -37,33 +125,32 @@ namespace VCX::Labs::GettingStarted {
         }
 
         void AdvanceMassSpringSystem(float const dt) {
-            auto const                         nDoFs = int(Positions.size()) * 3;
-            Eigen::SparseMatrix<float>         matLinearized(nDoFs, nDoFs);
-            std::vector<Eigen::Triplet<float>> coefficients;
-
-            const auto AddBlock = [&](int const p0, int const p1, glm::mat3 const & block) {
-                for (int i = 0; i < 3; i++)
-                    for (int j = 0; j < 3; j++)
-                        coefficients.emplace_back(p0 * 3 + i, p1 * 3 + j, block[j][i]);
+            auto const nDoFs = int(Positions.size()) * 3;
+            if (! Solver || MatLinearized.rows() != nDoFs || SpringNonZeros.size() != Springs.size()) build_pattern();
+            float * const values = MatLinearized.valuePtr();
+
+            // block b of spring s in rows and columns: 0 = (p0, p0), 1 = (p0, p1), 2 = (p1, p0), 3 = (p1, p1)
+            const auto AddBlock = [&](std::size_t const s, int const b, glm::mat3 const & block) {
+                for (int j = 0; j < 3; j++)
+                    for (int i = 0; i < 3; i++) values[SpringNonZeros[s][b * 3 + j] + i] += block[j][i];
             };
 
-            for (int i = 0; i < nDoFs; i++) coefficients.emplace_back(i, i, Mass);
+            std::fill(values, values + MatLinearized.nonZeros(), 0.f);
+            for (int i = 0; i < nDoFs; i++) values[DiagonalNonZeros[i]] = Mass;
 
-            for (auto const & spring : Springs) {
-                auto const p0 = spring.AdjIdx.first;
-                auto const p1 = spring.AdjIdx.second;
+            for (std::size_t s = 0; s < Springs.size(); s++) {
+                auto const p0 = Springs[s].AdjIdx.first;
+                auto const p1 = Springs[s].AdjIdx.second;
                 if (Fixed[p0] || Fixed[p1]) continue;
                 glm::vec3 const x01   = Positions[p1] - Positions[p0];
                 glm::vec3 const e01   = glm::normalize(x01);
                 glm::mat3 const block = Damping * glm::outerProduct(e01, e01) * dt;
-                AddBlock(p0, p0, -block);
-                AddBlock(p0, p1, block);
-                AddBlock(p1, p0, block);
-                AddBlock(p1, p1, -block);
+                AddBlock(s, 0, -block);
+                AddBlock(s, 1, block);
+                AddBlock(s, 2, block);
+                AddBlock(s, 3, -block);
             }
 
-            matLinearized.setFromTriplets(coefficients.begin(), coefficients.end());
-
             std::vector<glm::vec3> forces(Positions.size(), glm::vec3(0, -Gravity, 0) * Mass);
             for (std::size_t i = 0; i < Positions.size(); i++) {
                 if (Fixed[i]) forces[i] = glm::vec3(0);
@@ -82,25 +169,39 @@ namespace VCX::Labs::GettingStarted {
             auto vecVelocities = Eigen::Map<Eigen::VectorXf, Eigen::Aligned>(reinterpret_cast<float *>(Velocities.data()), nDoFs);
             auto vecForces     = Eigen::Map<Eigen::VectorXf, Eigen::Aligned>(reinterpret_cast<float *>(forces.data()), nDoFs);
 
-            Eigen::VectorXf rhsLinearized = matLinearized * vecVelocities + vecForces * dt;
+            Eigen::VectorXf rhsLinearized = MatLinearized * vecVelocities + vecForces * dt;
 
-            for (auto const & spring : Springs) {
-                auto const p0 = spring.AdjIdx.first;
-                auto const p1 = spring.AdjIdx.second;
+            for (std::size_t s = 0; s < Springs.size(); s++) {
+                auto const p0 = Springs[s].AdjIdx.first;
+                auto const p1 = Springs[s].AdjIdx.second;
                 if (Fixed[p0] || Fixed[p1]) continue;
                 glm::vec3 const x01    = Positions[p1] - Positions[p0];
                 glm::vec3 const e01    = glm::normalize(x01);
                 float const     length = glm::length(x01);
-                glm::mat3 const block  = Stiffness * ((spring.RestLength / length - 1) * glm::mat3(1) - spring.RestLength / length * glm::outerProduct(e01, e01)) * dt * dt;
-                AddBlock(p0, p0, -block);
-                AddBlock(p0, p1, block);
-                AddBlock(p1, p0, block);
-                AddBlock(p1, p1, -block);
+                glm::mat3 const block  = Stiffness * ((Springs[s].RestLength / length - 1) * glm::mat3(1) - Springs[s].RestLength / length * glm::outerProduct(e01, e01)) * dt * dt;
+                AddBlock(s, 0, -block);
+                AddBlock(s, 1, block);
+                AddBlock(s, 2, block);
+                AddBlock(s, 3, -block);
             }
 
-            matLinearized.setFromTriplets(coefficients.begin(), coefficients.end());
-            auto solver   = Eigen::SimplicialLLT<Eigen::SparseMatrix<float>>(matLinearized);
-            vecVelocities = solver.solve(rhsLinearized);
+            auto const   start = std::chrono::steady_clock::now();
+            SolveStats & stats = LastSolve[int(Linear)];
+            switch (Linear) {
+            case LinearSolver::Cholesky:
+                Solver->factorize(MatLinearized);
+                vecVelocities    = Solver->solve(rhsLinearized);
+                stats.Iterations = 0;
+                stats.Error      = 0;
+                break;
+            case LinearSolver::CGJacobi:
+                solve_cg(*JacobiCG, rhsLinearized, vecVelocities, stats);
+                break;
+            case LinearSolver::CGIncompleteCholesky:
+                solve_cg(*IncompleteCholeskyCG, rhsLinearized, vecVelocities, stats);
+                break;
+            }
+            stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
             for (std::size_t i = 0; i < Positions.size(); i++) {
                 Positions[i] += Velocities[i] * dt;
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Labs/Common/Parallel.h"
+
+namespace VCX::Labs::FEM {
+    // The faces of a tet mesh that belong to exactly one tet, wound so that their normals point out
+    // of the body. Indices refer to the simulator's particle array, so the particle positions can be
+    // uploaded as they are.
+    struct BoundarySurface {
+        std::vector<std::uint32_t> Indices;          // three per surface triangle
+        std::vector<glm::vec3>     Normals;          // one per particle, zero for interior particles
+        std::vector<int>           VertexTriOffsets; // CSR: surface triangles around each particle
+        std::vector<int>           VertexTriEntries;
+
+        std::size_t GetTriangleCount() const { return Indices.size() / 3; }
+
+        // 21 bits per sorted index, enough for two million particles
+        static std::uint64_t FaceKey(int a, int b, int c) {
+            if (a > b) std::swap(a, b);
+            if (b > c) std::swap(b, c);
+            if (a > b) std::swap(a, b);
+            return (std::uint64_t(a) << 42) | (std::uint64_t(b) << 21) | std::uint64_t(c);
+        }
+
+        void Build(std::vector<glm::vec3> const & positions, std::vector<glm::ivec4> const & tets) {
+            // face opposite to each vertex of a tet
+            static constexpr int c_Faces[4][4] = {
+                { 1, 2, 3, 0 },
+                { 0, 2, 3, 1 },
+                { 0, 1, 3, 2 },
+                { 0, 1, 2, 3 },
+            };
+
+            // number of tets sharing each face
+            std::unordered_map<std::uint64_t, int> faceCount;
+            faceCount.reserve(tets.size() * 4);
+            for (auto const & t : tets)
+                for (auto const & f : c_Faces)
+                    faceCount[FaceKey(t[f[0]], t[f[1]], t[f[2]])]++;
+
+            // emitted in tet order, which keeps neighbouring triangles close in the index buffer
+            Indices.clear();
+            for (auto const & t : tets) {
+                for (auto const & f : c_Faces) {
+                    int a = t[f[0]], b = t[f[1]], c = t[f[2]];
+                    if (faceCount[FaceKey(a, b, c)] != 1) continue;
+                    // the opposite vertex must lie behind the face
+                    glm::vec3 const n = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+                    if (glm::dot(n, positions[t[f[3]]] - positions[a]) > 0) std::swap(b, c);
+                    Indices.insert(Indices.end(), { std::uint32_t(a), std::uint32_t(b), std::uint32_t(c) });
+                }
+            }
+
+            VertexTriOffsets.assign(positions.size() + 1, 0);
+            for (auto const v : Indices) VertexTriOffsets[v + 1]++;
+            for (std::size_t v = 0; v < positions.size(); v++) VertexTriOffsets[v + 1] += VertexTriOffsets[v];
+            VertexTriEntries.resize(Indices.size());
+            std::vector<int> cursor(VertexTriOffsets.begin(), VertexTriOffsets.end() - 1);
+            for (std::size_t k = 0; k < Indices.size(); k++) VertexTriEntries[cursor[Indices[k]]++] = int(k / 3);
+
+            Normals.assign(positions.size(), glm::vec3(0));
+        }
+
+        // area-weighted vertex normals, gathered per vertex so the threads never write the same slot
+        void UpdateNormals(std::vector<glm::vec3> const & positions) {
+            Common::ParallelFor(0, positions.size(), [&](std::size_t const v) {
+                glm::vec3 n(0);
+                for (int k = VertexTriOffsets[v]; k < VertexTriOffsets[v + 1]; k++) {
+                    std::uint32_t const * tri = &Indices[VertexTriEntries[k] * 3];
+                    n += glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+                }
+                float const len = glm::length(n);
+                Normals[v]      = len > 0 ? n / len : n;
+            });
+        }
+    };
+} // namespace VCX::Labs::FEM
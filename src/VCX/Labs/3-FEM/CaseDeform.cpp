@@ -2,53 +2,237 @@
 #include "Labs/3-FEM/TetSystem.h"
 #include "Labs/Common/ImGuiHelper.h"
 #include "Engine/app.h"
+#include "Engine/loader.h"
+#include "Engine/Sphere.h"
+#include <array>
+#include <cmath>
 #include <iostream>
 #include "Labs/Common/ForceManager.h"
 
 
 
 namespace VCX::Labs::FEM {
+    static constexpr auto c_Integrators = std::array<char const *, 5> {
+        "Explicit (Substeps)",
+        "Implicit (Newton + PCG)",
+        "Implicit (Matrix-Free PCG)",
+        "XPBD",
+        "Modal (Reduced)",
+    };
+
+    static constexpr auto c_XPBDModes = std::array<char const *, 2> {
+        "Gauss-Seidel (Colored)",
+        "Jacobi (Averaged)",
+    };
+
+    static constexpr auto c_Materials = std::array<char const *, 4> {
+        "StVK",
+        "Neo-Hookean",
+        "Linear",
+        "Corotated Linear",
+    };
+
+    static constexpr auto c_Orderings = std::array<char const *, 3> {
+        "None",
+        "Reverse Cuthill-McKee",
+        "Morton",
+    };
+
+    static constexpr auto c_Preconditioners = std::array<char const *, 2> {
+        "Jacobi",
+        "Block Jacobi",
+    };
 
     CaseDeform::CaseDeform():
         _program(
-            Engine::GL::UniqueProgram({ Engine::GL::SharedShader("assets/shaders/flat.vert"),
-                                        Engine::GL::SharedShader("assets/shaders/flat.frag") })),
-        _tetItem(Engine::GL::VertexLayout().Add<glm::vec3>("position", Engine::GL::DrawFrequency::Stream, 0), Engine::GL::PrimitiveType::Triangles)
+            Engine::GL::UniqueProgram({ Engine::GL::SharedShader("assets/shaders/lit.vert"),
+                                        Engine::GL::SharedShader("assets/shaders/lit.frag") })),
+        _tetItem(Engine::GL::VertexLayout()
+            .Add<glm::vec3>("position", Engine::GL::DrawFrequency::Stream, 0)
+            .Add<glm::vec3>("normal", Engine::GL::DrawFrequency::Stream, 1), Engine::GL::PrimitiveType::Triangles),
+        _embeddedItem(Engine::GL::VertexLayout()
+            .Add<glm::vec3>("position", Engine::GL::DrawFrequency::Stream, 0)
+            .Add<glm::vec3>("normal", Engine::GL::DrawFrequency::Stream, 1), Engine::GL::PrimitiveType::Triangles)
          {
 
         _tetSystem.setupScene(8*2, 2*2, 2*2, 0.5f);
         // _tetSystem.setupSceneSimple();
-
-        const std::vector<std::uint32_t> tri_index_tet = { 0, 1, 2, 0, 1, 3, 0, 2, 3, 1, 2, 3};
-        std::vector<std::uint32_t> tri_index;
-
-        for(int i=0; i < _tetSystem.tet.size(); i++)
-        {
-            glm::ivec4 curtet = _tetSystem.tet[i];
-            for(int j=0; j<tri_index_tet.size(); j++)
-            {
-                tri_index.push_back(curtet[tri_index_tet[j]]);
-            }
-        }
-        _tetItem.UpdateElementBuffer(tri_index);
+        UpdateTetIndices();
         _cameraManager.AutoRotate = false;
         _cameraManager.Save(_camera);
 
     }
 
+    void CaseDeform::UpdateTetIndices() {
+        // interior faces are shared by two tets and never visible, only the boundary is uploaded
+        _tetItem.UpdateElementBuffer(_tetSystem.surface.Indices);
+    }
+
+    void CaseDeform::LoadMesh() {
+        TetMesh mesh = LoadTetMesh(_meshPath.data());
+        if(mesh.Tets.empty())
+            return;
+        ReorderTetMesh(mesh, VertexOrdering(_orderingId));
+        _tetSystem.setupSceneFromMesh(mesh);
+        UpdateTetIndices();
+    }
+
+    void CaseDeform::VoxelizeMesh() {
+        Engine::SurfaceMesh surface = Engine::LoadSurfaceMesh(_renderMeshPath.data());
+        if(surface.Positions.empty())
+            return;
+        // fitted into the box of the procedural bar, whose parameters suit the simulator defaults
+        surface.NormalizePositions(glm::vec3(0.0f), glm::vec3(8.0f, 2.0f, 2.0f));
+        TetMesh mesh = VoxelizeSurfaceMesh(surface, _voxelResolution);
+        if(mesh.Tets.empty())
+            return;
+        ReorderTetMesh(mesh, VertexOrdering(_orderingId));
+        _tetSystem.setupSceneFromMesh(mesh);
+        UpdateTetIndices();
+        EmbedRenderMesh(std::move(surface));
+    }
+
+    void CaseDeform::EmbedRenderMesh(Engine::SurfaceMesh mesh) {
+        if(mesh.Positions.empty())
+            return;
+        _tetSystem.EmbedSurfaceMesh(std::move(mesh));
+        _embeddedItem.UpdateElementBuffer(_tetSystem.embedded.Mesh.Indices);
+    }
+
     void CaseDeform::ResetSystem() {
         _tetSystem.particlePos = _tetSystem.particlePosRest;
         _tetSystem.particleVel = _tetSystem.particleVelRest;
+        _tetSystem.Wake();
     }
 
     void CaseDeform::OnSetupPropsUI() {
         if(ImGui::Button("Reset System")) 
             ResetSystem();
+        ImGui::SameLine();
+        if(ImGui::Button("Procedural Bar")) {
+            _tetSystem.setupScene(8*2, 2*2, 2*2, 0.5f);
+            UpdateTetIndices();
+        }
+
+        ImGui::InputText("Mesh (.node/.msh)", _meshPath.data(), _meshPath.size());
+        ImGui::Combo("Vertex Order", &_orderingId, c_Orderings.data(), c_Orderings.size());
+        if(ImGui::Button("Load Tet Mesh"))
+            LoadMesh();
+        ImGui::Spacing();
+
+        // render meshes are fitted to the rest bounding box of the tets
+        glm::vec3 cageMin(std::numeric_limits<float>::max());
+        glm::vec3 cageMax(-std::numeric_limits<float>::max());
+        for(auto const & p : _tetSystem.particlePosRest) {
+            cageMin = glm::min(cageMin, p);
+            cageMax = glm::max(cageMax, p);
+        }
+        ImGui::InputText("Render Mesh (.obj)", _renderMeshPath.data(), _renderMeshPath.size());
+        if(ImGui::Button("Embed OBJ")) {
+            Engine::SurfaceMesh mesh = Engine::LoadSurfaceMesh(_renderMeshPath.data());
+            mesh.NormalizePositions(cageMin, cageMax);
+            EmbedRenderMesh(std::move(mesh));
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Voxelize OBJ"))
+            VoxelizeMesh();
+        ImGui::SameLine();
+        if(ImGui::Button("Embed Ellipsoid")) {
+            // inscribed in the cage, so every vertex has a containing tet
+            Engine::SurfaceMesh mesh = Engine::Sphere(_ellipsoidPrecision, 1.0f);
+            glm::vec3 const center = 0.5f * (cageMin + cageMax);
+            glm::vec3 const radius = 0.499f * (cageMax - cageMin);
+            for(std::size_t i = 0; i < mesh.Positions.size(); i++) {
+                mesh.Positions[i] = center + radius * mesh.Positions[i];
+                mesh.Normals[i] = glm::normalize(mesh.Normals[i] / radius);
+            }
+            EmbedRenderMesh(std::move(mesh));
+        }
+        ImGui::SliderInt("Voxel Resolution", &_voxelResolution, 4, 128);
+        ImGui::SliderInt("Ellipsoid Precision", &_ellipsoidPrecision, 16, 512);
+        if(!_tetSystem.embedded.Empty()) {
+            ImGui::Text("Render mesh: %d vertices, %d triangles", int(_tetSystem.embedded.Mesh.GetVertexCount()), int(_tetSystem.embedded.Mesh.Indices.size() / 3));
+            ImGui::Checkbox("Show Cage", &_showCage);
+        }
+        ImGui::Spacing();
 
         ImGui::SliderFloat("Gravity", &_tetSystem.g, 0.0f, 1.0f);
         ImGui::SliderFloat("Young", &_tetSystem.young, 1000.0f, 100000.0f);
         ImGui::SliderFloat("Poison", &_tetSystem.poison, -1.0f, 0.5f);
         ImGui::SliderFloat("Friction", &_tetSystem.friction, 0.0f, 100.0f);
+        int materialId = int(_tetSystem.material);
+        if(ImGui::Combo("Material", &materialId, c_Materials.data(), c_Materials.size()))
+            _tetSystem.material = Material(materialId);
+        if(_tetSystem.material == Material::Corotated)
+            ImGui::SliderInt("Rotation Iters", &_tetSystem.rotationIterations, 1, 10);
+        ImGui::Text("Surface: %d triangles, %d tets", int(_tetSystem.surface.GetTriangleCount()), int(_tetSystem.tet.size()));
+        ImGui::Spacing();
+
+        int integratorId = int(_tetSystem.integrator);
+        if(ImGui::Combo("Integrator", &integratorId, c_Integrators.data(), c_Integrators.size()))
+            _tetSystem.integrator = Integrator(integratorId);
+        if(_tetSystem.integrator == Integrator::Explicit) {
+            ImGui::Checkbox("Adaptive Substeps", &_tetSystem.adaptiveSubsteps);
+            if(_tetSystem.adaptiveSubsteps) {
+                ImGui::SliderFloat("Safety", &_tetSystem.stabilitySafety, 0.1f, 1.0f);
+                ImGui::Text("Substeps: %d", _tetSystem.lastSubsteps);
+            } else
+                ImGui::SliderInt("Substeps", &_tetSystem.explicitSubsteps, 1, 100);
+        } else if(_tetSystem.integrator == Integrator::XPBD) {
+            // the constraints are Neo-Hookean whatever material is selected
+            ImGui::SliderInt("Substeps", &_tetSystem.xpbdSubsteps, 1, 100);
+            int modeId = int(_tetSystem.xpbdMode);
+            if(ImGui::Combo("Projection", &modeId, c_XPBDModes.data(), c_XPBDModes.size()))
+                _tetSystem.xpbdMode = XPBDMode(modeId);
+            if(_tetSystem.xpbdMode == XPBDMode::Jacobi)
+                ImGui::SliderFloat("Relaxation", &_tetSystem.xpbdRelaxation, 0.5f, 2.0f);
+            else
+                ImGui::Text("Colors: %d", std::max(int(_tetSystem.xpbd.colorOffsets.size()) - 1, 0));
+        } else if(_tetSystem.integrator == Integrator::Modal) {
+            // no collisions, the modes cannot represent contact
+            ImGui::SliderInt("Modes", &_tetSystem.modalCount, 1, 128);
+            ImGui::Checkbox("Cubature", &_tetSystem.modalCubature);
+            if(_tetSystem.modalCubature)
+                ImGui::SliderInt("Cubature Tets", &_tetSystem.cubatureTetCount, 16, 4096);
+            auto const & basis = _tetSystem.modal.basis;
+            if(basis.GetModeCount() > 0) {
+                float const scale = std::sqrt(_tetSystem.young / basis.Young);
+                ImGui::Text("omega %.3g .. %.3g", scale * std::sqrt(basis.Eigenvalues[0]), scale * std::sqrt(basis.Eigenvalues[basis.GetModeCount() - 1]));
+            }
+        } else {
+            ImGui::SliderInt("Newton Iters", &_tetSystem.newtonIterations, 1, 10);
+            ImGui::SliderInt("CG Max Iters", &_tetSystem.cgMaxIterations, 10, 1000);
+            if(_tetSystem.integrator == Integrator::Implicit) {
+                ImGui::Checkbox("Project Stiffness", &_tetSystem.projectStiffness);
+            } else {
+                int preconditionerId = int(_tetSystem.preconditioner);
+                if(ImGui::Combo("Preconditioner", &preconditionerId, c_Preconditioners.data(), c_Preconditioners.size()))
+                    _tetSystem.preconditioner = Preconditioner(preconditionerId);
+                ImGui::Checkbox("Warm Start", &_tetSystem.warmStart);
+            }
+            ImGui::Text("Newton: %d, CG: %d", _tetSystem.lastNewtonIterations, _tetSystem.lastCGIterations);
+            if(_tetSystem.lastProjectionRetries > 0)
+                ImGui::Text("Projection Retries: %d", _tetSystem.lastProjectionRetries);
+        }
+        ImGui::Spacing();
+
+        if(ImGui::Checkbox("Sleep", &_tetSystem.allowSleep) && !_tetSystem.allowSleep)
+            _tetSystem.Wake();
+        ImGui::SameLine();
+        if(_tetSystem.sleeping)
+            ImGui::Text("asleep");
+        else
+            ImGui::Text("KE %.2e, residual %.2e", _tetSystem.lastKineticEnergy, _tetSystem.lastResidualNorm);
+        ImGui::Spacing();
+
+        ImGui::Checkbox("Ground", &_tetSystem.groundCollision);
+        ImGui::SameLine();
+        ImGui::Checkbox("Self Collision", &_tetSystem.selfCollision);
+        if(_tetSystem.groundCollision)
+            ImGui::SliderFloat("Ground Height", &_tetSystem.groundHeight, -3.0f, 0.0f);
+        if(_tetSystem.selfCollision)
+            ImGui::SliderFloat("Thickness", &_tetSystem.collisionThickness, 0.01f, 0.5f);
+        ImGui::Text("Contacts: %d (dropped %d)", _tetSystem.lastContactCount, _tetSystem.contacts.Dropped.load());
         ImGui::Spacing();
     }
 
@@ -68,19 +252,29 @@ namespace VCX::Labs::FEM {
         _program.GetUniforms().SetByName("u_Projection", _camera.GetProjectionMatrix((float(desiredSize.first) / desiredSize.second)));
         _program.GetUniforms().SetByName("u_View", _camera.GetViewMatrix());
 
-        gl_using(_frame);
-        glEnable(GL_LINE_SMOOTH);
-        glLineWidth(.5f);
+        bool const drawEmbedded = !_tetSystem.embedded.Empty() && !_showCage;
+        if(drawEmbedded)
+            _tetSystem.UpdateEmbedded();
+        else
+            _tetSystem.surface.UpdateNormals(_tetSystem.particlePos);
 
-        auto span_bytes = Engine::make_span_bytes<glm::vec3>(_tetSystem.particlePos);
+        gl_using(_frame);
+        glEnable(GL_DEPTH_TEST);
 
         _program.GetUniforms().SetByName("u_Color", glm::vec3{ 121.0f / 255, 207.0f / 255, 171.0f / 255 });
-        _tetItem.UpdateVertexBuffer("position", span_bytes);
-        _tetItem.Draw({ _program.Use() });
+        _program.GetUniforms().SetByName("u_LightDirection", glm::normalize(_camera.Target - _camera.Eye));
+        _program.GetUniforms().SetByName("u_Ambient", .3f);
+        if(drawEmbedded) {
+            _embeddedItem.UpdateVertexBuffer("position", Engine::make_span_bytes<glm::vec3>(_tetSystem.embedded.Mesh.Positions));
+            _embeddedItem.UpdateVertexBuffer("normal", Engine::make_span_bytes<glm::vec3>(_tetSystem.embedded.Mesh.Normals));
+            _embeddedItem.Draw({ _program.Use() });
+        } else {
+            _tetItem.UpdateVertexBuffer("position", Engine::make_span_bytes<glm::vec3>(_tetSystem.particlePos));
+            _tetItem.UpdateVertexBuffer("normal", Engine::make_span_bytes<glm::vec3>(_tetSystem.surface.Normals));
+            _tetItem.Draw({ _program.Use() });
+        }
 
-        glLineWidth(1.f);
-        glPointSize(1.f);
-        glDisable(GL_LINE_SMOOTH);
+        glDisable(GL_DEPTH_TEST);
 
         return Common::CaseRenderResult {
             .Fixed     = false,
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
@@ -7,6 +9,7 @@
 #include "Engine/GL/Frame.hpp"
 #include "Engine/GL/Program.h"
 #include "Engine/GL/RenderItem.h"
+#include "Labs/3-FEM/BoundarySurface.h"
 #include "Labs/3-FEM/TetSystem.h"
 #include "Labs/Common/ICase.h"
 #include "Labs/Common/ImageRGB.h"
@@ -27,6 +30,9 @@ namespace VCX::Labs::FEM {
 
         void OnProcessMouseControl(std::pair<glm::vec3,int> force);
         void ResetSystem();
+        void LoadMesh();
+        void VoxelizeMesh();
+        void EmbedRenderMesh(Engine::SurfaceMesh mesh);
         
         // void Advance(float timeDelta);
 
@@ -35,8 +41,17 @@ namespace VCX::Labs::FEM {
         Engine::GL::UniqueRenderFrame       _frame;
         Engine::Camera                      _camera { .Eye = glm::vec3(-3, 3, 3) };
         Common::OrbitCameraManager          _cameraManager;
-        Engine::GL::UniqueIndexedRenderItem _tetItem;  // render the tet
+        Engine::GL::UniqueIndexedRenderItem _tetItem;  // render the boundary surface of the tets
+        Engine::GL::UniqueIndexedRenderItem _embeddedItem; // dense mesh carried by the tets
         FEM::Simulator                      _tetSystem;
         Common::ForceManager                _forceManager;
+        std::array<char, 256>               _meshPath {};
+        int                                 _orderingId { int(VertexOrdering::ReverseCuthillMcKee) };
+        std::array<char, 256>               _renderMeshPath {};
+        int                                 _voxelResolution { 32 };
+        int                                 _ellipsoidPrecision { 256 };
+        bool                                _showCage { false };
+
+        void UpdateTetIndices();
     };
 } // namespace VCX::Labs::RigidBody
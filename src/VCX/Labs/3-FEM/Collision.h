@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Labs/3-FEM/BoundarySurface.h"
+#include "Labs/Common/Parallel.h"
+
+namespace VCX::Labs::FEM {
+    // Bounding volume hierarchy over the triangles of a BoundarySurface. The topology is built once;
+    // afterwards only the boxes are refit to the deformed positions.
+    struct SurfaceBVH {
+        struct Node {
+            glm::vec3 Min;
+            int       Right; // internal: index of the right child, the left child is the next node
+            glm::vec3 Max;
+            int       Count; // leaf: number of triangles starting at First, 0 for internal nodes
+            int       First;
+        };
+
+        static constexpr int c_LeafSize   = 4;
+        static constexpr int c_StackDepth = 64;
+
+        std::vector<Node> Nodes;    // preorder, so every child has a larger index than its parent
+        std::vector<int>  TriOrder; // triangle ids referenced by the leaves
+
+        void Build(BoundarySurface const & surface, std::vector<glm::vec3> const & positions) {
+            int const              nTris = int(surface.GetTriangleCount());
+            std::vector<glm::vec3> centroids(nTris);
+            for (int t = 0; t < nTris; t++)
+                centroids[t] = (positions[surface.Indices[3 * t]] + positions[surface.Indices[3 * t + 1]] + positions[surface.Indices[3 * t + 2]]) / 3.f;
+            TriOrder.resize(nTris);
+            for (int t = 0; t < nTris; t++) TriOrder[t] = t;
+            Nodes.clear();
+            Nodes.reserve(std::max(1, 2 * nTris / c_LeafSize + 1));
+            if (nTris > 0) BuildRange(centroids, 0, nTris);
+            Refit(surface, positions, 0.f);
+        }
+
+        // leaves first, then parents in reverse preorder; boxes are padded by margin
+        void Refit(BoundarySurface const & surface, std::vector<glm::vec3> const & positions, float const margin) {
+            Common::ParallelFor(0, Nodes.size(), [&](std::size_t const i) {
+                Node & node = Nodes[i];
+                if (node.Count == 0) return;
+                glm::vec3 lo(std::numeric_limits<float>::max());
+                glm::vec3 hi(-std::numeric_limits<float>::max());
+                for (int k = node.First; k < node.First + node.Count; k++) {
+                    for (int j = 0; j < 3; j++) {
+                        glm::vec3 const & p = positions[surface.Indices[3 * TriOrder[k] + j]];
+                        lo                  = glm::min(lo, p);
+                        hi                  = glm::max(hi, p);
+                    }
+                }
+                node.Min = lo - glm::vec3(margin);
+                node.Max = hi + glm::vec3(margin);
+            }, 64);
+            for (int i = int(Nodes.size()) - 1; i >= 0; i--) {
+                Node & node = Nodes[i];
+                if (node.Count > 0) continue;
+                node.Min = glm::min(Nodes[i + 1].Min, Nodes[node.Right].Min);
+                node.Max = glm::max(Nodes[i + 1].Max, Nodes[node.Right].Max);
+            }
+        }
+
+        // calls func(triangle) for every leaf triangle whose box overlaps [lo, hi]
+        template<typename Func>
+        void Query(glm::vec3 const & lo, glm::vec3 const & hi, Func && func) const {
+            if (Nodes.empty()) return;
+            int stack[c_StackDepth];
+            int top      = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                Node const & node = Nodes[stack[--top]];
+                if (node.Min.x > hi.x || node.Max.x < lo.x || node.Min.y > hi.y || node.Max.y < lo.y || node.Min.z > hi.z || node.Max.z < lo.z) continue;
+                if (node.Count > 0) {
+                    for (int k = node.First; k < node.First + node.Count; k++) func(TriOrder[k]);
+                } else if (top + 2 <= c_StackDepth) {
+                    stack[top++] = node.Right;
+                    stack[top++] = int(&node - Nodes.data()) + 1;
+                }
+            }
+        }
+
+    private:
+        int BuildRange(std::vector<glm::vec3> const & centroids, int const begin, int const end) {
+            int const index = int(Nodes.size());
+            Nodes.push_back({});
+            if (end - begin <= c_LeafSize) {
+                Nodes[index].Count = end - begin;
+                Nodes[index].First = begin;
+                return index;
+            }
+            glm::vec3 lo(std::numeric_limits<float>::max());
+            glm::vec3 hi(-std::numeric_limits<float>::max());
+            for (int k = begin; k < end; k++) {
+                lo = glm::min(lo, centroids[TriOrder[k]]);
+                hi = glm::max(hi, centroids[TriOrder[k]]);
+            }
+            glm::vec3 const extent = hi - lo;
+            int const       axis   = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            int const       mid    = (begin + end) / 2;
+            std::nth_element(TriOrder.begin() + begin, TriOrder.begin() + mid, TriOrder.begin() + end, [&](int const a, int const b) {
+                return centroids[a][axis] < centroids[b][axis];
+            });
+            BuildRange(centroids, begin, mid);
+            int const right     = BuildRange(centroids, mid, end);
+            Nodes[index].Right = right;
+            Nodes[index].Count = 0;
+            return index;
+        }
+    };
+
+    struct Contact {
+        int       Vertex;
+        int       Triangle;
+        glm::vec3 Bary;   // closest point on the triangle
+        glm::vec3 Normal; // outward normal of the triangle
+        float     Depth;  // how far the vertex has to move along Normal
+    };
+
+    // Fixed-capacity contact list filled concurrently by the narrow phase. Capacity is set when the
+    // surface changes; contacts beyond it are counted and dropped instead of growing the buffer.
+    struct ContactBuffer {
+        std::vector<Contact> Data;
+        std::atomic<int>     Count { 0 };
+        std::atomic<int>     Dropped { 0 };
+
+        void Reserve(std::size_t const capacity) { Data.resize(capacity); }
+
+        void Clear() {
+            Count   = 0;
+            Dropped = 0;
+        }
+
+        void Push(Contact const & contact) {
+            int const slot = Count.fetch_add(1);
+            if (slot < int(Data.size())) Data[slot] = contact;
+            else Dropped++;
+        }
+
+        int Size() const { return std::min(Count.load(), int(Data.size())); }
+    };
+
+    // Closest point to p on triangle abc as barycentric weights (Ericson, Real-Time Collision Detection 5.1.5).
+    inline glm::vec3 ClosestPointBarycentric(glm::vec3 const & p, glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c) {
+        glm::vec3 const ab = b - a, ac = c - a, ap = p - a;
+        float const     d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0 && d2 <= 0) return { 1, 0, 0 };
+        glm::vec3 const bp = p - b;
+        float const     d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0 && d4 <= d3) return { 0, 1, 0 };
+        float const vc = d1 * d4 - d3 * d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+            float const v = d1 / (d1 - d3);
+            return { 1 - v, v, 0 };
+        }
+        glm::vec3 const cp = p - c;
+        float const     d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0 && d5 <= d6) return { 0, 0, 1 };
+        float const vb = d5 * d2 - d1 * d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+            float const w = d2 / (d2 - d6);
+            return { 1 - w, 0, w };
+        }
+        float const va = d3 * d6 - d5 * d4;
+        if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+            float const w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            return { 0, 1 - w, w };
+        }
+        float const denom = 1.f / (va + vb + vc);
+        float const v     = vb * denom;
+        float const w     = vc * denom;
+        return { 1 - v - w, v, w };
+    }
+} // namespace VCX::Labs::FEM
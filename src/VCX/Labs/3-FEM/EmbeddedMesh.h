@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Engine/SurfaceMesh.h"
+#include "Labs/Common/Parallel.h"
+
+namespace VCX::Labs::FEM {
+    // A dense render mesh carried by a coarse tet cage. Every vertex is bound once to one cage tet
+    // through its barycentric weights; afterwards a frame costs one weighted gather per vertex.
+    // Vertices slightly outside the cage use the weights of the nearest tet, which extrapolates.
+    struct EmbeddedMesh {
+        Engine::SurfaceMesh     Mesh;        // Positions and Normals are rewritten by Update
+        std::vector<glm::vec3>  RestNormals;
+        std::vector<glm::ivec4> Nodes;       // cage particles of the bound tet, gathered without indirection
+        std::vector<glm::vec4>  Weights;     // barycentric weights, summing to one
+        std::vector<int>        VertexTet;
+        std::vector<glm::mat3>  TetCofactor; // cof(F) = det(F) F^-T of every cage tet, maps rest normals
+
+        bool Empty() const { return Mesh.Positions.empty(); }
+
+        void Clear() {
+            Mesh = {};
+            RestNormals.clear();
+            Nodes.clear();
+            Weights.clear();
+            VertexTet.clear();
+            TetCofactor.clear();
+        }
+
+        static glm::vec4 Barycentric(glm::vec3 const & p, glm::vec3 const & x0, glm::mat3 const & DmInv) {
+            glm::vec3 const b = DmInv * (p - x0);
+            return { 1.0f - b.x - b.y - b.z, b.x, b.y, b.z };
+        }
+
+        static float MinComponent(glm::vec4 const & w) { return std::min(std::min(w.x, w.y), std::min(w.z, w.w)); }
+
+        void Bind(Engine::SurfaceMesh mesh, std::vector<glm::vec3> const & cageRest, std::vector<glm::ivec4> const & tets, std::vector<glm::mat3> const & restDmInv) {
+            Clear();
+            if (tets.empty() || mesh.Positions.empty()) return;
+            if (! mesh.IsNormalAvailable()) mesh.Normals = mesh.ComputeNormals();
+            Mesh        = std::move(mesh);
+            RestNormals = Mesh.Normals;
+
+            // uniform grid of about one tet per cell, each tet listed in every cell its box touches
+            glm::vec3 lo(std::numeric_limits<float>::max());
+            glm::vec3 hi(-std::numeric_limits<float>::max());
+            for (auto const & p : cageRest) {
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+            glm::vec3 const extent = glm::max(hi - lo, glm::vec3(1e-6f));
+            float const     cell   = std::cbrt(extent.x * extent.y * extent.z / float(tets.size()));
+            glm::ivec3 const dims  = glm::clamp(glm::ivec3(glm::ceil(extent / cell)), glm::ivec3(1), glm::ivec3(256));
+            glm::vec3 const scale  = glm::vec3(dims) / extent;
+            auto const cellOf = [&](glm::vec3 const & p) {
+                return glm::clamp(glm::ivec3(glm::floor((p - lo) * scale)), glm::ivec3(0), dims - 1);
+            };
+            auto const cellIndex = [&](glm::ivec3 const & c) { return (c.x * dims.y + c.y) * dims.z + c.z; };
+
+            std::vector<int> cellOffsets(dims.x * dims.y * dims.z + 1, 0);
+            std::vector<int> cellEntries;
+            for (int pass = 0; pass < 2; pass++) {
+                std::vector<int> cursor;
+                if (pass == 1) {
+                    for (std::size_t c = 1; c < cellOffsets.size(); c++) cellOffsets[c] += cellOffsets[c - 1];
+                    cellEntries.resize(cellOffsets.back());
+                    cursor.assign(cellOffsets.begin(), cellOffsets.end() - 1);
+                }
+                for (int t = 0; t < int(tets.size()); t++) {
+                    glm::vec3 tlo = cageRest[tets[t][0]], thi = tlo;
+                    for (int j = 1; j < 4; j++) {
+                        tlo = glm::min(tlo, cageRest[tets[t][j]]);
+                        thi = glm::max(thi, cageRest[tets[t][j]]);
+                    }
+                    glm::ivec3 const c0 = cellOf(tlo), c1 = cellOf(thi);
+                    for (int x = c0.x; x <= c1.x; x++)
+                        for (int y = c0.y; y <= c1.y; y++)
+                            for (int z = c0.z; z <= c1.z; z++) {
+                                int const c = cellIndex({ x, y, z });
+                                if (pass == 0) cellOffsets[c + 1]++;
+                                else cellEntries[cursor[c]++] = t;
+                            }
+                }
+            }
+
+            std::size_t const n = Mesh.Positions.size();
+            Nodes.resize(n);
+            Weights.resize(n);
+            VertexTet.resize(n);
+            Common::ParallelFor(0, n, [&](std::size_t const v) {
+                glm::vec3 const p    = Mesh.Positions[v];
+                int             best = -1;
+                float           bestScore = -std::numeric_limits<float>::max();
+                auto const      test = [&](int const t) {
+                    float const score = MinComponent(Barycentric(p, cageRest[tets[t][0]], restDmInv[t]));
+                    if (score > bestScore) {
+                        bestScore = score;
+                        best      = t;
+                    }
+                };
+                int const c = cellIndex(cellOf(p));
+                for (int k = cellOffsets[c]; k < cellOffsets[c + 1]; k++) test(cellEntries[k]);
+                // outside the cage or in an empty cell: the tet that contains it "least badly"
+                if (bestScore < -1e-4f)
+                    for (int t = 0; t < int(tets.size()); t++) test(t);
+                Nodes[v]     = tets[best];
+                Weights[v]   = Barycentric(p, cageRest[tets[best][0]], restDmInv[best]);
+                VertexTet[v] = best;
+            }, 64);
+            TetCofactor.resize(tets.size());
+        }
+
+        void Update(std::vector<glm::vec3> const & positions, std::vector<glm::ivec4> const & tets, std::vector<glm::mat3> const & restDmInv) {
+            if (Empty()) return;
+            Common::ParallelFor(0, tets.size(), [&](std::size_t const t) {
+                glm::vec3 const x0 = positions[tets[t][0]];
+                glm::mat3 const F  = glm::mat3(positions[tets[t][1]] - x0, positions[tets[t][2]] - x0, positions[tets[t][3]] - x0) * restDmInv[t];
+                TetCofactor[t]     = glm::mat3(glm::cross(F[1], F[2]), glm::cross(F[2], F[0]), glm::cross(F[0], F[1]));
+            });
+            // four weighted loads and no branches per vertex; large chunks keep each thread streaming
+            glm::vec3 *       outPos    = Mesh.Positions.data();
+            glm::vec3 *       outNormal = Mesh.Normals.data();
+            glm::ivec4 const * nodes    = Nodes.data();
+            glm::vec4 const *  weights  = Weights.data();
+            Common::ParallelFor(0, Mesh.Positions.size(), [&](std::size_t const v) {
+                glm::ivec4 const & i = nodes[v];
+                glm::vec4 const &  w = weights[v];
+                outPos[v]            = w.x * positions[i.x] + w.y * positions[i.y] + w.z * positions[i.z] + w.w * positions[i.w];
+                glm::vec3 const nrm  = TetCofactor[VertexTet[v]] * RestNormals[v];
+                outNormal[v]         = nrm * (1.0f / std::sqrt(std::max(glm::dot(nrm, nrm), 1e-30f)));
+            }, 2048);
+        }
+    };
+} // namespace VCX::Labs::FEM
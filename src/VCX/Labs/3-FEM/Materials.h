@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace VCX::Labs::FEM {
+    struct LameParameters {
+        float Lambda;
+        float Mu;
+    };
+
+    inline float Trace(glm::mat3 const & m) { return m[0][0] + m[1][1] + m[2][2]; }
+
+    inline float DoubleContraction(glm::mat3 const & a, glm::mat3 const & b) {
+        return glm::dot(a[0], b[0]) + glm::dot(a[1], b[1]) + glm::dot(a[2], b[2]);
+    }
+
+    // cof(F) = det(F) F^-T, also defined for degenerate and inverted F
+    inline glm::mat3 Cofactor(glm::mat3 const & F) {
+        return glm::mat3(glm::cross(F[1], F[2]), glm::cross(F[2], F[0]), glm::cross(F[0], F[1]));
+    }
+
+    // Material policies. Each one gives the first Piola-Kirchhoff stress P(F) and its differential
+    // dP(F; dF). R is the rotation of the tet, only read by policies with Rotated = true. The FEM
+    // kernels are templates over these types, so choosing a model costs one switch per pass
+    // instead of a branch per element.
+
+    struct StVKMaterial {
+        static constexpr bool Rotated = false;
+
+        static glm::mat3 Stress(glm::mat3 const & F, glm::mat3 const &, LameParameters const & lame) {
+            glm::mat3 const G = 0.5f * (glm::transpose(F) * F - glm::mat3(1.0f)); // Green-Lagrange strain
+            glm::mat3 const S = 2 * lame.Mu * G + lame.Lambda * Trace(G) * glm::mat3(1.0f);
+            return F * S;
+        }
+
+        static glm::mat3 StressDifferential(glm::mat3 const & F, glm::mat3 const &, glm::mat3 const & dF, LameParameters const & lame) {
+            glm::mat3 const G  = 0.5f * (glm::transpose(F) * F - glm::mat3(1.0f));
+            glm::mat3 const S  = 2 * lame.Mu * G + lame.Lambda * Trace(G) * glm::mat3(1.0f);
+            glm::mat3 const dG = 0.5f * (glm::transpose(dF) * F + glm::transpose(F) * dF);
+            glm::mat3 const dS = 2 * lame.Mu * dG + lame.Lambda * Trace(dG) * glm::mat3(1.0f);
+            return dF * S + F * dS;
+        }
+    };
+
+    // small-strain elasticity, P is linear in F
+    struct LinearMaterial {
+        static constexpr bool Rotated = false;
+
+        static glm::mat3 Stress(glm::mat3 const & F, glm::mat3 const &, LameParameters const & lame) {
+            glm::mat3 const E = 0.5f * (F + glm::transpose(F)) - glm::mat3(1.0f);
+            return 2 * lame.Mu * E + lame.Lambda * Trace(E) * glm::mat3(1.0f);
+        }
+
+        static glm::mat3 StressDifferential(glm::mat3 const &, glm::mat3 const &, glm::mat3 const & dF, LameParameters const & lame) {
+            glm::mat3 const dE = 0.5f * (dF + glm::transpose(dF));
+            return 2 * lame.Mu * dE + lame.Lambda * Trace(dE) * glm::mat3(1.0f);
+        }
+    };
+
+    // linear elasticity in the rotated frame, P = R P_lin(R^T F); dR is ignored as usual. The
+    // simulator evaluates Rotated policies through the cached rest stiffness K_e of each tet,
+    // R K_e (R^T x - X), which is the same force at a fraction of the cost.
+    struct CorotatedMaterial {
+        static constexpr bool Rotated = true;
+
+        static glm::mat3 Stress(glm::mat3 const & F, glm::mat3 const & R, LameParameters const & lame) {
+            return R * LinearMaterial::Stress(glm::transpose(R) * F, R, lame);
+        }
+
+        static glm::mat3 StressDifferential(glm::mat3 const &, glm::mat3 const & R, glm::mat3 const & dF, LameParameters const & lame) {
+            return R * LinearMaterial::StressDifferential(dF, R, glm::transpose(R) * dF, lame);
+        }
+    };
+
+    // Stable Neo-Hookean of Smith et al. 2018 without the log barrier term,
+    // psi = mu / 2 (tr(F^T F) - 3) + lambda' / 2 (J - alpha)^2. With lambda' = lambda + mu and
+    // alpha = 1 + mu / lambda' it is stress free at rest, agrees with the Lame parameters for small
+    // strains and stays finite for inverted tets.
+    struct NeoHookeanMaterial {
+        static constexpr bool Rotated = false;
+
+        static glm::mat3 Stress(glm::mat3 const & F, glm::mat3 const &, LameParameters const & lame) {
+            float const lambda = lame.Lambda + lame.Mu;
+            float const alpha  = 1.0f + lame.Mu / lambda;
+            return lame.Mu * F + lambda * (glm::determinant(F) - alpha) * Cofactor(F);
+        }
+
+        static glm::mat3 StressDifferential(glm::mat3 const & F, glm::mat3 const &, glm::mat3 const & dF, LameParameters const & lame) {
+            float const     lambda = lame.Lambda + lame.Mu;
+            float const     alpha  = 1.0f + lame.Mu / lambda;
+            glm::mat3 const C      = Cofactor(F);
+            glm::mat3 const dC(
+                glm::cross(dF[1], F[2]) + glm::cross(F[1], dF[2]),
+                glm::cross(dF[2], F[0]) + glm::cross(F[2], dF[0]),
+                glm::cross(dF[0], F[1]) + glm::cross(F[0], dF[1]));
+            return lame.Mu * dF + lambda * (DoubleContraction(C, dF) * C + (glm::determinant(F) - alpha) * dC);
+        }
+    };
+} // namespace VCX::Labs::FEM
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <spdlog/spdlog.h>
+
+#include "Labs/3-FEM/ModalReduction.h"
+
+namespace VCX::Labs::FEM {
+    static constexpr char          c_CacheMagic[8] = { 'V', 'C', 'X', 'M', 'O', 'D', 'E', '1' };
+    static constexpr std::uint64_t c_FnvOffset     = 1469598103934665603ull;
+    static constexpr std::uint64_t c_FnvPrime      = 1099511628211ull;
+
+    static void HashBytes(std::uint64_t & hash, void const * data, std::size_t const size) {
+        auto const * bytes = static_cast<unsigned char const *>(data);
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= c_FnvPrime;
+        }
+    }
+
+    std::uint64_t ModalBasisKey(
+        std::vector<glm::vec3> const &  positionsRest,
+        std::vector<glm::ivec4> const & tets,
+        std::vector<int> const &        fixed,
+        float const                     poison,
+        float const                     mass,
+        int const                       modeCount) {
+        std::uint64_t hash = c_FnvOffset;
+        HashBytes(hash, positionsRest.data(), positionsRest.size() * sizeof(glm::vec3));
+        HashBytes(hash, tets.data(), tets.size() * sizeof(glm::ivec4));
+        HashBytes(hash, fixed.data(), fixed.size() * sizeof(int));
+        HashBytes(hash, &poison, sizeof(poison));
+        HashBytes(hash, &mass, sizeof(mass));
+        HashBytes(hash, &modeCount, sizeof(modeCount));
+        return hash;
+    }
+
+    std::filesystem::path DefaultModalCacheDir() {
+        std::error_code ec;
+        auto            dir = std::filesystem::temp_directory_path(ec);
+        return ec ? std::filesystem::path(".") : dir;
+    }
+
+    static std::filesystem::path CachePath(std::filesystem::path const & cacheDir, std::uint64_t const key) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "vcx-fem-modes-%016llx.bin", static_cast<unsigned long long>(key));
+        return cacheDir / name;
+    }
+
+    static bool LoadModalBasis(std::filesystem::path const & fileName, std::uint64_t const key, ModalBasis & basis) {
+        std::ifstream file(fileName, std::ios::binary);
+        if (! file) return false;
+        char          magic[8];
+        std::uint64_t fileKey = 0;
+        std::int64_t  rows = 0, cols = 0;
+        float         young = 0;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char *>(&fileKey), sizeof(fileKey));
+        file.read(reinterpret_cast<char *>(&rows), sizeof(rows));
+        file.read(reinterpret_cast<char *>(&cols), sizeof(cols));
+        file.read(reinterpret_cast<char *>(&young), sizeof(young));
+        if (! file || std::memcmp(magic, c_CacheMagic, sizeof(magic)) != 0 || fileKey != key || rows <= 0 || cols <= 0) return false;
+        basis.Eigenvalues.resize(cols);
+        basis.Modes.resize(rows, cols);
+        file.read(reinterpret_cast<char *>(basis.Eigenvalues.data()), cols * sizeof(float));
+        file.read(reinterpret_cast<char *>(basis.Modes.data()), rows * cols * sizeof(float));
+        if (! file) return false;
+        basis.Young = young;
+        basis.Key   = key;
+        return true;
+    }
+
+    static void SaveModalBasis(std::filesystem::path const & fileName, ModalBasis const & basis) {
+        std::ofstream file(fileName, std::ios::binary);
+        if (! file) {
+            spdlog::warn("VCX::Labs::FEM::SaveModalBasis(\"{}\"): cannot write the cache.", fileName.string());
+            return;
+        }
+        std::int64_t const rows = basis.Modes.rows(), cols = basis.Modes.cols();
+        file.write(c_CacheMagic, sizeof(c_CacheMagic));
+        file.write(reinterpret_cast<char const *>(&basis.Key), sizeof(basis.Key));
+        file.write(reinterpret_cast<char const *>(&rows), sizeof(rows));
+        file.write(reinterpret_cast<char const *>(&cols), sizeof(cols));
+        file.write(reinterpret_cast<char const *>(&basis.Young), sizeof(basis.Young));
+        file.write(reinterpret_cast<char const *>(basis.Eigenvalues.data()), cols * sizeof(float));
+        file.write(reinterpret_cast<char const *>(basis.Modes.data()), rows * cols * sizeof(float));
+    }
+
+    // K of linear elasticity at the rest shape, restricted to the free DoFs given by dofIndex
+    static Eigen::SparseMatrix<double> AssembleRestStiffness(
+        std::vector<glm::vec3> const &  positionsRest,
+        std::vector<glm::ivec4> const & tets,
+        std::vector<int> const &        dofIndex,
+        int const                       nFree,
+        LameParameters const &          lame) {
+        std::vector<Eigen::Triplet<double>> coefficients;
+        coefficients.reserve(tets.size() * 144);
+        for (auto const & t : tets) {
+            glm::mat3 const Dm(positionsRest[t[1]] - positionsRest[t[0]], positionsRest[t[2]] - positionsRest[t[0]], positionsRest[t[3]] - positionsRest[t[0]]);
+            float const     volume = std::abs(glm::determinant(Dm)) / 6.0f;
+            if (volume <= 0.0f) continue;
+            glm::mat3 const DmInv  = glm::inverse(Dm);
+            glm::mat3 const DmInvT = glm::transpose(DmInv);
+            // column (b, c) of K_e is the nodal response to a unit displacement of node b along axis c
+            for (int b = 0; b < 4; b++) {
+                if (dofIndex[3 * t[b]] < 0) continue;
+                for (int c = 0; c < 3; c++) {
+                    glm::mat3 dDs(0.0f);
+                    for (int k = 0; k < 3; k++) {
+                        if (b == 0) dDs[k][c] = -1.0f;
+                        else if (b == k + 1) dDs[k][c] = 1.0f;
+                    }
+                    glm::mat3 const dP = LinearMaterial::StressDifferential(glm::mat3(1.0f), glm::mat3(1.0f), dDs * DmInv, lame);
+                    glm::mat3 const H  = volume * dP * DmInvT;
+                    glm::vec3 const H0 = -H[0] - H[1] - H[2];
+                    int const       col = dofIndex[3 * t[b] + c];
+                    for (int a = 0; a < 4; a++) {
+                        glm::vec3 const & column = a == 0 ? H0 : H[a - 1];
+                        for (int r = 0; r < 3; r++) {
+                            int const row = dofIndex[3 * t[a] + r];
+                            if (row >= 0) coefficients.emplace_back(row, col, column[r]);
+                        }
+                    }
+                }
+            }
+        }
+        Eigen::SparseMatrix<double> K(nFree, nFree);
+        K.setFromTriplets(coefficients.begin(), coefficients.end());
+        return K;
+    }
+
+    ModalBasis ComputeModalBasis(
+        std::vector<glm::vec3> const &  positionsRest,
+        std::vector<glm::ivec4> const & tets,
+        std::vector<int> const &        fixed,
+        float const                     young,
+        float const                     poison,
+        float const                     mass,
+        int const                       modeCount,
+        std::filesystem::path const &   cacheDir) {
+        ModalBasis          basis;
+        std::uint64_t const key       = ModalBasisKey(positionsRest, tets, fixed, poison, mass, modeCount);
+        auto const          cachePath = CachePath(cacheDir, key);
+        if (LoadModalBasis(cachePath, key, basis)) {
+            spdlog::info("VCX::Labs::FEM::ComputeModalBasis: {} modes loaded from \"{}\".", basis.GetModeCount(), cachePath.string());
+            return basis;
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+
+        std::vector<int> dofIndex(positionsRest.size() * 3, -1);
+        int              nFree = 0;
+        for (std::size_t i = 0; i < positionsRest.size(); i++)
+            if (! fixed[i])
+                for (int c = 0; c < 3; c++) dofIndex[3 * i + c] = nFree++;
+        int const k = std::min(modeCount, nFree);
+        if (k <= 0 || mass <= 0.0f) return {};
+
+        LameParameters const lame {
+            young * poison / ((1 + poison) * (1 - 2 * poison)),
+            young / (2 * (1 + poison)),
+        };
+        Eigen::SparseMatrix<double> const K = AssembleRestStiffness(positionsRest, tets, dofIndex, nFree, lame);
+
+        // a small shift keeps the factorization definite when nothing is pinned; it only moves the eigenvalues
+        double const shift = 1e-8 * K.diagonal().mean() / mass;
+        Eigen::SparseMatrix<double> A = K;
+        for (int i = 0; i < nFree; i++) A.coeffRef(i, i) += shift * mass;
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver(A);
+        if (solver.info() != Eigen::Success) {
+            spdlog::error("VCX::Labs::FEM::ComputeModalBasis: the stiffness matrix could not be factorized.");
+            return {};
+        }
+
+        // subspace iteration with Rayleigh-Ritz, the guard vectors speed up convergence of the wanted k
+        int const       p = std::min(nFree, std::max(2 * k, k + 8));
+        Eigen::MatrixXd X(nFree, p);
+        std::mt19937    rng(12345);
+        std::normal_distribution<double> normal;
+        for (Eigen::Index i = 0; i < X.size(); i++) X.data()[i] = normal(rng);
+
+        Eigen::VectorXd lambdas = Eigen::VectorXd::Zero(p);
+        Eigen::MatrixXd Y;
+        int             iteration = 0;
+        for (; iteration < 100; iteration++) {
+            Y = solver.solve(mass * X);
+            Eigen::MatrixXd const Kr = Y.transpose() * (A * Y);
+            Eigen::MatrixXd const Mr = mass * (Y.transpose() * Y);
+            Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd> eig(0.5 * (Kr + Kr.transpose()), 0.5 * (Mr + Mr.transpose()));
+            if (eig.info() != Eigen::Success) break;
+            X = Y * eig.eigenvectors(); // M-orthonormal, sorted by eigenvalue
+            double change = 0;
+            for (int j = 0; j < k; j++)
+                change = std::max(change, std::abs(eig.eigenvalues()[j] - lambdas[j]) / std::max(std::abs(eig.eigenvalues()[j]), 1e-30));
+            lambdas = eig.eigenvalues();
+            if (change < 1e-8) break;
+        }
+
+        basis.Modes = Eigen::MatrixXf::Zero(Eigen::Index(positionsRest.size() * 3), k);
+        for (std::size_t row = 0; row < dofIndex.size(); row++)
+            if (dofIndex[row] >= 0)
+                basis.Modes.row(row) = X.row(dofIndex[row]).head(k).cast<float>();
+        basis.Eigenvalues = (lambdas.head(k).array() - shift).max(0.0).cast<float>();
+        basis.Young       = young;
+        basis.Key         = key;
+
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        spdlog::info(
+            "VCX::Labs::FEM::ComputeModalBasis: {} modes of {} DoFs in {} iterations, {:.2f} s, omega {:.3g} .. {:.3g}.",
+            k, nFree, iteration + 1, seconds, std::sqrt(basis.Eigenvalues[0]), std::sqrt(basis.Eigenvalues[k - 1]));
+        SaveModalBasis(cachePath, basis);
+        return basis;
+    }
+
+    // Lawson-Hanson on the normal equations G w = c of the selected columns, which are few enough
+    // for their Gram matrix to be small. w holds feasible weights on input, the previous fit padded
+    // with zeros for the new columns, and the solution on output.
+    static void SolveNonNegative(Eigen::MatrixXd const & G, Eigen::VectorXd const & c, Eigen::VectorXd & w) {
+        int const         s = int(c.size());
+        std::vector<char> passive(s);
+        for (int i = 0; i < s; i++) passive[i] = w[i] > 0;
+
+        // least squares on the passive set, stepping back to the boundary while a weight turns negative
+        auto const solvePassive = [&]() {
+            for (int guard = 0; guard <= s; guard++) {
+                std::vector<int> set;
+                for (int i = 0; i < s; i++)
+                    if (passive[i]) set.push_back(i);
+                if (set.empty()) return;
+                int const       p = int(set.size());
+                Eigen::MatrixXd Gp(p, p);
+                Eigen::VectorXd cp(p);
+                for (int i = 0; i < p; i++) {
+                    cp[i] = c[set[i]];
+                    for (int j = 0; j < p; j++) Gp(i, j) = G(set[i], set[j]);
+                }
+                Eigen::VectorXd const z = Gp.ldlt().solve(cp);
+                double alpha = 1;
+                for (int i = 0; i < p; i++)
+                    if (z[i] <= 0) alpha = std::min(alpha, w[set[i]] / std::max(w[set[i]] - z[i], 1e-300));
+                for (int i = 0; i < p; i++) w[set[i]] += alpha * (z[i] - w[set[i]]);
+                if (alpha >= 1) return;
+                for (int i = 0; i < p; i++) {
+                    if (w[set[i]] <= 1e-12 * std::abs(z[i])) {
+                        w[set[i]]       = 0;
+                        passive[set[i]] = false;
+                    }
+                }
+            }
+        };
+
+        solvePassive();
+        double const scale = std::max(G.diagonal().maxCoeff(), 1e-300);
+        for (int outer = 0; outer < 3 * s; outer++) {
+            Eigen::VectorXd const gradient = c - G * w;
+            int                   best     = -1;
+            for (int i = 0; i < s; i++)
+                if (! passive[i] && gradient[i] > 1e-10 * scale && (best < 0 || gradient[i] > gradient[best])) best = i;
+            if (best < 0) return;
+            passive[best] = true;
+            solvePassive();
+        }
+    }
+
+    CubatureRule FitCubature(Eigen::MatrixXf const & A, Eigen::VectorXf const & b, int const maxSamples, float const tolerance) {
+        CubatureRule       rule;
+        Eigen::Index const nCandidates = A.cols();
+        double const       bNorm       = b.cast<double>().norm();
+        if (nCandidates == 0 || bNorm <= 0) return rule;
+
+        Eigen::VectorXf const norms = A.colwise().norm().transpose();
+        int const             limit = int(std::min<Eigen::Index>(std::max(maxSamples, 1), nCandidates));
+        std::vector<int>      selected;
+        std::vector<char>     taken(nCandidates, false);
+        Eigen::MatrixXd       G;
+        Eigen::VectorXd       c, w;
+        Eigen::VectorXf       residual = b;
+        std::vector<int>      order;
+        while (int(selected.size()) < limit && residual.cast<double>().norm() > tolerance * bNorm) {
+            // an eighth of the selected count at a time, so that the weights are refit only a few dozen times
+            Eigen::VectorXf const score = A.transpose() * residual;
+            order.clear();
+            for (Eigen::Index e = 0; e < nCandidates; e++)
+                if (! taken[e] && norms[e] > 0 && score[e] > 0) order.push_back(int(e));
+            if (order.empty()) break;
+            std::size_t const batch = std::min<std::size_t>({ std::max<std::size_t>(1, selected.size() / 8), std::size_t(limit) - selected.size(), order.size() });
+            std::partial_sort(order.begin(), order.begin() + batch, order.end(), [&](int const x, int const y) {
+                return score[x] / norms[x] > score[y] / norms[y];
+            });
+
+            int const s0 = int(selected.size());
+            int const s1 = s0 + int(batch);
+            for (std::size_t i = 0; i < batch; i++) {
+                selected.push_back(order[i]);
+                taken[order[i]] = true;
+            }
+            G.conservativeResize(s1, s1);
+            c.conservativeResize(s1);
+            w.conservativeResize(s1);
+            for (int j = s0; j < s1; j++) {
+                auto const column = A.col(selected[j]).cast<double>();
+                for (int i = 0; i <= j; i++) G(i, j) = G(j, i) = A.col(selected[i]).cast<double>().dot(column);
+                c[j] = column.dot(b.cast<double>());
+                w[j] = 0;
+            }
+            SolveNonNegative(G, c, w);
+
+            residual = b;
+            for (int i = 0; i < s1; i++)
+                if (w[i] > 0) residual -= float(w[i]) * A.col(selected[i]);
+        }
+
+        for (std::size_t i = 0; i < selected.size(); i++) {
+            if (w[i] <= 0) continue;
+            rule.Elements.push_back(selected[i]);
+            rule.Weights.push_back(float(w[i]));
+        }
+        rule.TrainingError = float(residual.cast<double>().norm() / bNorm);
+        return rule;
+    }
+} // namespace VCX::Labs::FEM
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <Eigen/Dense>
+#include <glm/glm.hpp>
+
+#include "Labs/3-FEM/Materials.h"
+
+namespace VCX::Labs::FEM {
+    // Lowest vibration modes of a pinned tet mesh around its rest shape, for linear elasticity
+    // and a uniformly lumped mass. The modes are mass-orthonormal, Modes^T M Modes = I, and the
+    // rows of pinned particles are zero.
+    struct ModalBasis {
+        Eigen::MatrixXf Modes;       // 3n x k, (particle, axis) rows
+        Eigen::VectorXf Eigenvalues; // omega^2 of each mode for the Young's modulus the basis was built with
+        float           Young = 0;
+        std::uint64_t   Key   = 0;
+
+        int GetModeCount() const { return int(Modes.cols()); }
+    };
+
+    // Hash of everything the mode shapes depend on. Young's modulus only scales the eigenvalues
+    // and is left out, so dragging its slider never triggers a rebuild.
+    std::uint64_t ModalBasisKey(
+        std::vector<glm::vec3> const &  positionsRest,
+        std::vector<glm::ivec4> const & tets,
+        std::vector<int> const &        fixed,
+        float const                     poison,
+        float const                     mass,
+        int const                       modeCount);
+
+    // Assembles K of linear elasticity at rest over the free DoFs and computes its lowest
+    // modeCount eigenpairs against M = mass I by shift-invert subspace iteration on a sparse
+    // Cholesky factor of K. A basis with the same key in cacheDir is loaded instead, and a newly
+    // computed one is written there. Returns an empty basis if the problem is degenerate.
+    ModalBasis ComputeModalBasis(
+        std::vector<glm::vec3> const &  positionsRest,
+        std::vector<glm::ivec4> const & tets,
+        std::vector<int> const &        fixed,
+        float const                     young,
+        float const                     poison,
+        float const                     mass,
+        int const                       modeCount,
+        std::filesystem::path const &   cacheDir);
+
+    // Directory for cached bases, the system temporary directory when it is available.
+    std::filesystem::path DefaultModalCacheDir();
+
+    // A reduced force sum_e f_e approximated by sum_s Weights[s] f_{Elements[s]} over a few elements.
+    struct CubatureRule {
+        std::vector<int>   Elements;
+        std::vector<float> Weights;
+        float              TrainingError = 0; // relative residual of the fit
+    };
+
+    // Optimized cubature of An, Kim and James 2008. Column e of A holds the reduced force of
+    // candidate element e in every training pose, stacked, and b the full reduced force of the
+    // poses. Elements are added greedily by their correlation with the residual and the weights of
+    // all selected ones are refit by non-negative least squares, until the relative residual drops
+    // below tolerance or maxSamples elements are selected. Returned elements index the columns of A.
+    CubatureRule FitCubature(Eigen::MatrixXf const & A, Eigen::VectorXf const & b, int const maxSamples, float const tolerance);
+} // namespace VCX::Labs::FEM
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace VCX::Labs::FEM {
+    // Rotation stored as a quaternion (x, y, z, w).
+    inline glm::mat3 QuatToMat3(glm::vec4 const & q) {
+        float const x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+        float const xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+        float const xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+        float const wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+        return glm::mat3(
+            1.0f - yy - zz, xy + wz, xz - wy,
+            xy - wz, 1.0f - xx - zz, yz + wx,
+            xz + wy, yz - wx, 1.0f - xx - yy);
+    }
+
+    // Rotational part of A by the iteration of Mueller et al. 2016, "A Robust Method to Extract
+    // the Rotational Part of Deformations". q holds the previous rotation on input and is refined
+    // in place. The iteration count is fixed and the loop has no data-dependent branches, so
+    // running it over many elements vectorizes well.
+    inline glm::mat3 ExtractRotation(glm::mat3 const & A, glm::vec4 & q, int const iterations = 3) {
+        for (int it = 0; it < iterations; it++) {
+            glm::mat3 const R     = QuatToMat3(q);
+            glm::vec3 const num   = glm::cross(R[0], A[0]) + glm::cross(R[1], A[1]) + glm::cross(R[2], A[2]);
+            float const     denom = std::abs(glm::dot(R[0], A[0]) + glm::dot(R[1], A[1]) + glm::dot(R[2], A[2])) + 1e-9f;
+            glm::vec3 const omega = num / denom;
+            float const     w     = glm::length(omega);
+            // axis-angle quaternion of omega, sin(w/2)/w stays finite as w goes to 0
+            float const     s     = std::sin(0.5f * w) / (w + 1e-20f);
+            glm::vec3 const dv    = omega * s;
+            float const     dw    = std::cos(0.5f * w);
+            glm::vec3 const qv(q.x, q.y, q.z);
+            glm::vec3 const v  = dw * qv + q.w * dv + glm::cross(dv, qv);
+            float const     nw = dw * q.w - glm::dot(dv, qv);
+            float const     inv = 1.0f / std::sqrt(glm::dot(v, v) + nw * nw);
+            q = glm::vec4(v * inv, nw * inv);
+        }
+        return QuatToMat3(q);
+    }
+} // namespace VCX::Labs::FEM
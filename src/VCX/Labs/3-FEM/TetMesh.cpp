@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+
+#include "Labs/3-FEM/TetMesh.h"
+
+namespace VCX::Labs::FEM {
+    // next line that is neither empty nor a '#' comment (TetGen style)
+    static bool NextDataLine(std::istream & in, std::istringstream & line) {
+        std::string str;
+        while (std::getline(in, str)) {
+            auto const pos = str.find('#');
+            if (pos != std::string::npos) str.erase(pos);
+            if (str.find_first_not_of(" \t\r") == std::string::npos) continue;
+            line.clear();
+            line.str(str);
+            return true;
+        }
+        return false;
+    }
+
+    static TetMesh LoadTetMeshTetGen(std::filesystem::path const & fileName) {
+        auto nodeName = fileName;
+        auto eleName  = fileName;
+        nodeName.replace_extension(".node");
+        eleName.replace_extension(".ele");
+
+        std::ifstream nodeFile(nodeName);
+        std::ifstream eleFile(eleName);
+        if (! nodeFile || ! eleFile) {
+            spdlog::error("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\"): .node or .ele not found.", fileName.filename().string());
+            return {};
+        }
+
+        TetMesh            mesh;
+        std::istringstream line;
+        std::size_t        nPoints = 0, dim = 0;
+        if (! NextDataLine(nodeFile, line) || ! (line >> nPoints >> dim) || dim != 3) {
+            spdlog::error("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\"): bad .node header.", fileName.filename().string());
+            return {};
+        }
+        int base = 0;
+        mesh.Positions.resize(nPoints);
+        for (std::size_t i = 0; i < nPoints; i++) {
+            int       id;
+            glm::vec3 p;
+            if (! NextDataLine(nodeFile, line) || ! (line >> id >> p.x >> p.y >> p.z)) {
+                spdlog::error("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\"): truncated .node file.", fileName.filename().string());
+                return {};
+            }
+            if (i == 0) base = id;
+            mesh.Positions[i] = p;
+        }
+
+        std::size_t nTets = 0, nodesPerTet = 0;
+        if (! NextDataLine(eleFile, line) || ! (line >> nTets >> nodesPerTet) || nodesPerTet < 4) {
+            spdlog::error("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\"): bad .ele header.", fileName.filename().string());
+            return {};
+        }
+        mesh.Tets.resize(nTets);
+        for (std::size_t i = 0; i < nTets; i++) {
+            int        id;
+            glm::ivec4 t;
+            if (! NextDataLine(eleFile, line) || ! (line >> id >> t.x >> t.y >> t.z >> t.w)) {
+                spdlog::error("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\"): truncated .ele file.", fileName.filename().string());
+                return {};
+            }
+            for (int j = 0; j < 4; j++) {
+                t[j] -= base;
+                if (t[j] < 0 || t[j] >= int(nPoints)) {
+                    spdlog::error("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\"): tet {} references a missing node.", fileName.filename().string(), id);
+                    return {};
+                }
+            }
+            mesh.Tets[i] = t;
+        }
+        spdlog::trace("VCX::Labs::FEM::LoadTetMeshTetGen(\"{}\")", fileName.filename().string());
+        return mesh;
+    }
+
+    static TetMesh LoadTetMeshGmsh(std::filesystem::path const & fileName) {
+        std::ifstream file(fileName);
+        if (! file) {
+            spdlog::error("VCX::Labs::FEM::LoadTetMeshGmsh(\"{}\"): not found.", fileName.filename().string());
+            return {};
+        }
+
+        // gmsh element types: 4 is a 4-node tet, 11 a 10-node tet
+        auto const nodesOfType = [](int const type) {
+            static constexpr int c_Nodes[] = { 0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13 };
+            return type > 0 && type < int(std::size(c_Nodes)) ? c_Nodes[type] : -1;
+        };
+
+        TetMesh                                 mesh;
+        std::unordered_map<std::size_t, int>    nodeIndex;
+        std::vector<std::array<std::size_t, 4>> tetTags;
+        float                                   version = 0;
+        std::string                             section;
+        bool                                    ok = true;
+
+        const auto fail = [&](char const * what) {
+            spdlog::error("VCX::Labs::FEM::LoadTetMeshGmsh(\"{}\"): {}.", fileName.filename().string(), what);
+            ok = false;
+        };
+        const auto addElement = [&](int const type, std::istream & in) {
+            int const n = nodesOfType(type);
+            if (n < 0) {
+                fail("unknown element type");
+                return false;
+            }
+            std::vector<std::size_t> tags(n);
+            for (auto & tag : tags) in >> tag;
+            if (type == 4 || type == 11) tetTags.push_back({ tags[0], tags[1], tags[2], tags[3] });
+            return bool(in);
+        };
+
+        while (ok && file >> section) {
+            if (section == "$MeshFormat") {
+                int fileType = 0, dataSize = 0;
+                file >> version >> fileType >> dataSize;
+                if (fileType != 0) fail("binary files are not supported");
+                else if (version < 2.0f || version >= 5.0f) fail("unsupported format version");
+            } else if (section == "$Nodes") {
+                if (version < 4.0f) {
+                    std::size_t n;
+                    file >> n;
+                    for (std::size_t i = 0; i < n && ok; i++) {
+                        std::size_t tag;
+                        glm::vec3   p;
+                        if (! (file >> tag >> p.x >> p.y >> p.z)) fail("truncated $Nodes");
+                        nodeIndex[tag] = int(mesh.Positions.size());
+                        mesh.Positions.push_back(p);
+                    }
+                } else {
+                    std::size_t nBlocks, n, minTag, maxTag;
+                    file >> nBlocks >> n >> minTag >> maxTag;
+                    mesh.Positions.reserve(n);
+                    for (std::size_t b = 0; b < nBlocks && ok; b++) {
+                        int         entityDim, entityTag, parametric;
+                        std::size_t nInBlock;
+                        file >> entityDim >> entityTag >> parametric >> nInBlock;
+                        if (parametric) {
+                            fail("parametric nodes are not supported");
+                            break;
+                        }
+                        std::vector<std::size_t> tags(nInBlock);
+                        for (auto & tag : tags) file >> tag;
+                        for (auto const tag : tags) {
+                            glm::vec3 p;
+                            file >> p.x >> p.y >> p.z;
+                            nodeIndex[tag] = int(mesh.Positions.size());
+                            mesh.Positions.push_back(p);
+                        }
+                        if (! file) fail("truncated $Nodes");
+                    }
+                }
+            } else if (section == "$Elements") {
+                if (version < 4.0f) {
+                    std::size_t n;
+                    file >> n;
+                    for (std::size_t i = 0; i < n && ok; i++) {
+                        std::size_t tag;
+                        int         type, nTags;
+                        file >> tag >> type >> nTags;
+                        for (int k = 0; k < nTags; k++) file >> tag;
+                        if (! addElement(type, file) && ok) fail("truncated $Elements");
+                    }
+                } else {
+                    std::size_t nBlocks, n, minTag, maxTag;
+                    file >> nBlocks >> n >> minTag >> maxTag;
+                    for (std::size_t b = 0; b < nBlocks && ok; b++) {
+                        int         entityDim, entityTag, type;
+                        std::size_t nInBlock;
+                        file >> entityDim >> entityTag >> type >> nInBlock;
+                        for (std::size_t i = 0; i < nInBlock && ok; i++) {
+                            std::size_t tag;
+                            file >> tag;
+                            if (! addElement(type, file) && ok) fail("truncated $Elements");
+                        }
+                    }
+                }
+            }
+        }
+        if (! ok) return {};
+
+        mesh.Tets.reserve(tetTags.size());
+        for (auto const & tags : tetTags) {
+            glm::ivec4 t;
+            for (int j = 0; j < 4; j++) {
+                auto const it = nodeIndex.find(tags[j]);
+                if (it == nodeIndex.end()) {
+                    fail("element references a missing node");
+                    return {};
+                }
+                t[j] = it->second;
+            }
+            mesh.Tets.push_back(t);
+        }
+        if (mesh.Tets.empty()) {
+            fail("no tetrahedra found");
+            return {};
+        }
+        spdlog::trace("VCX::Labs::FEM::LoadTetMeshGmsh(\"{}\")", fileName.filename().string());
+        return mesh;
+    }
+
+    TetMesh LoadTetMesh(std::filesystem::path const & fileName) {
+        auto const ext = fileName.extension();
+        if (ext == ".node" || ext == ".ele") {
+            return LoadTetMeshTetGen(fileName);
+        } else if (ext == ".msh") {
+            return LoadTetMeshGmsh(fileName);
+        } else {
+            spdlog::error("VCX::Labs::FEM::LoadTetMesh(\"{}\"): undertermined file format.", fileName.filename().string());
+            return {};
+        }
+    }
+
+    std::pair<std::size_t, float> ComputeBandwidth(TetMesh const & mesh) {
+        std::vector<int> rowBandwidth(mesh.Positions.size(), 0);
+        for (auto const & t : mesh.Tets)
+            for (int a = 0; a < 4; a++)
+                for (int b = 0; b < 4; b++)
+                    rowBandwidth[t[a]] = std::max(rowBandwidth[t[a]], std::abs(t[a] - t[b]));
+        if (rowBandwidth.empty()) return { 0, 0.f };
+        std::size_t const maxBandwidth = std::size_t(*std::max_element(rowBandwidth.begin(), rowBandwidth.end()));
+        float const       mean         = float(std::accumulate(rowBandwidth.begin(), rowBandwidth.end(), 0.0) / rowBandwidth.size());
+        return { maxBandwidth, mean };
+    }
+
+    // vertex adjacency through tet edges, in CSR form
+    static void BuildAdjacency(TetMesh const & mesh, std::vector<int> & offsets, std::vector<int> & neighbors) {
+        std::size_t const             n = mesh.Positions.size();
+        std::vector<std::vector<int>> adj(n);
+        for (auto const & t : mesh.Tets)
+            for (int a = 0; a < 4; a++)
+                for (int b = 0; b < 4; b++)
+                    if (a != b) adj[t[a]].push_back(t[b]);
+        offsets.assign(n + 1, 0);
+        neighbors.clear();
+        for (std::size_t i = 0; i < n; i++) {
+            std::sort(adj[i].begin(), adj[i].end());
+            adj[i].erase(std::unique(adj[i].begin(), adj[i].end()), adj[i].end());
+            neighbors.insert(neighbors.end(), adj[i].begin(), adj[i].end());
+            offsets[i + 1] = int(neighbors.size());
+        }
+    }
+
+    static std::vector<int> OrderReverseCuthillMcKee(TetMesh const & mesh) {
+        std::vector<int> offsets, neighbors;
+        BuildAdjacency(mesh, offsets, neighbors);
+        int const  n      = int(mesh.Positions.size());
+        auto const degree = [&](int const v) { return offsets[v + 1] - offsets[v]; };
+
+        // breadth-first levels from start, returns the last vertex reached (a far-away one)
+        std::vector<int> level(n, -1);
+        const auto       farthest = [&](int const start, std::vector<int> & component) {
+            component.clear();
+            component.push_back(start);
+            level[start] = 0;
+            int last     = start;
+            for (std::size_t k = 0; k < component.size(); k++) {
+                int const v = component[k];
+                for (int e = offsets[v]; e < offsets[v + 1]; e++) {
+                    int const u = neighbors[e];
+                    if (level[u] >= 0) continue;
+                    level[u] = level[v] + 1;
+                    component.push_back(u);
+                    if (level[u] > level[last] || (level[u] == level[last] && degree(u) < degree(last))) last = u;
+                }
+            }
+            for (int const v : component) level[v] = -1;
+            return last;
+        };
+
+        std::vector<int>  order;
+        std::vector<int>  component;
+        std::vector<char> visited(n, 0);
+        order.reserve(n);
+        for (int seed = 0; seed < n; seed++) {
+            if (visited[seed]) continue;
+            // a pseudo-peripheral start vertex: two sweeps of "go to the farthest vertex"
+            int const start = farthest(farthest(seed, component), component);
+            std::size_t const begin = order.size();
+            order.push_back(start);
+            visited[start] = 1;
+            std::vector<int> next;
+            for (std::size_t k = begin; k < order.size(); k++) {
+                int const v = order[k];
+                next.clear();
+                for (int e = offsets[v]; e < offsets[v + 1]; e++)
+                    if (! visited[neighbors[e]]) next.push_back(neighbors[e]);
+                std::sort(next.begin(), next.end(), [&](int const a, int const b) { return degree(a) < degree(b); });
+                for (int const u : next) {
+                    visited[u] = 1;
+                    order.push_back(u);
+                }
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    static std::uint32_t SpreadBits10(std::uint32_t x) {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    static std::vector<int> OrderMorton(TetMesh const & mesh) {
+        glm::vec3 minP(std::numeric_limits<float>::max());
+        glm::vec3 maxP(-std::numeric_limits<float>::max());
+        for (auto const & p : mesh.Positions) {
+            minP = glm::min(minP, p);
+            maxP = glm::max(maxP, p);
+        }
+        glm::vec3 const            scale = 1023.f / glm::max(maxP - minP, glm::vec3(1e-20f));
+        std::vector<std::uint32_t> code(mesh.Positions.size());
+        for (std::size_t i = 0; i < code.size(); i++) {
+            glm::vec3 const q = (mesh.Positions[i] - minP) * scale;
+            code[i]           = SpreadBits10(std::uint32_t(q.x)) | (SpreadBits10(std::uint32_t(q.y)) << 1) | (SpreadBits10(std::uint32_t(q.z)) << 2);
+        }
+        std::vector<int> order(mesh.Positions.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int const a, int const b) { return code[a] < code[b]; });
+        return order;
+    }
+
+    std::vector<int> ReorderTetMesh(TetMesh & mesh, VertexOrdering const ordering) {
+        auto const before = ComputeBandwidth(mesh);
+
+        std::vector<int> order;
+        if (ordering == VertexOrdering::ReverseCuthillMcKee) order = OrderReverseCuthillMcKee(mesh);
+        else if (ordering == VertexOrdering::Morton) order = OrderMorton(mesh);
+        else {
+            order.resize(mesh.Positions.size());
+            std::iota(order.begin(), order.end(), 0);
+        }
+
+        std::vector<int>       newIndex(mesh.Positions.size());
+        std::vector<glm::vec3> positions(mesh.Positions.size());
+        for (std::size_t i = 0; i < order.size(); i++) {
+            newIndex[order[i]] = int(i);
+            positions[i]       = mesh.Positions[order[i]];
+        }
+        mesh.Positions = std::move(positions);
+        for (auto & t : mesh.Tets)
+            for (int j = 0; j < 4; j++) t[j] = newIndex[t[j]];
+
+        // vertex order inside a tet carries its orientation, so only the tets themselves are sorted
+        const auto key = [](glm::ivec4 const & t) {
+            return std::min(std::min(t.x, t.y), std::min(t.z, t.w));
+        };
+        std::stable_sort(mesh.Tets.begin(), mesh.Tets.end(), [&](glm::ivec4 const & a, glm::ivec4 const & b) { return key(a) < key(b); });
+
+        auto const after = ComputeBandwidth(mesh);
+        spdlog::info(
+            "VCX::Labs::FEM::ReorderTetMesh: {} vertices, {} tets, bandwidth {} -> {}, mean row bandwidth {:.1f} -> {:.1f}",
+            mesh.Positions.size(),
+            mesh.Tets.size(),
+            before.first,
+            after.first,
+            before.second,
+            after.second);
+        return newIndex;
+    }
+} // namespace VCX::Labs::FEM
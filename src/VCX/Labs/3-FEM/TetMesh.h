@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Engine/SurfaceMesh.h"
+
+namespace VCX::Labs::FEM {
+    struct TetMesh {
+        std::vector<glm::vec3>  Positions;
+        std::vector<glm::ivec4> Tets;
+    };
+
+    enum class VertexOrdering {
+        None,
+        ReverseCuthillMcKee,
+        Morton,
+    };
+
+    // Loads a TetGen .node/.ele pair (either file name can be given) or an ASCII Gmsh .msh file
+    // (format 2.2 or 4.1). Only 4-node tets are kept, 10-node tets are reduced to their corners.
+    // On failure an empty mesh is returned and an error is emitted to spdlog.
+    TetMesh LoadTetMesh(std::filesystem::path const & fileName);
+
+    // Fills a closed triangle mesh with cubes, the longest side of its bounding box spanning
+    // resolution cubes. A cube is kept when its center is inside by the even-odd rule along x, and
+    // is split into the same six tets as Simulator::setupScene. Corners are shared between cubes.
+    TetMesh VoxelizeSurfaceMesh(Engine::SurfaceMesh const & mesh, int const resolution);
+
+    // Largest |i - j| over all tet edges, and its mean over all vertices.
+    std::pair<std::size_t, float> ComputeBandwidth(TetMesh const & mesh);
+
+    // Renumbers the vertices for locality and sorts the tets by their smallest vertex index.
+    // Returns the new index of every old vertex. Bandwidth before and after is logged.
+    std::vector<int> ReorderTetMesh(TetMesh & mesh, VertexOrdering const ordering);
+} // namespace VCX::Labs::FEM
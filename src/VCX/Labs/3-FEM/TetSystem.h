@@ -1,16 +1,58 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <Eigen/IterativeLinearSolvers>
 #include <glm/glm.hpp>
 #include <iostream>
 #include <utility>
 #include <vector>
 #include <cmath>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <spdlog/spdlog.h>
+
+#include "Labs/3-FEM/BoundarySurface.h"
+#include "Labs/3-FEM/Collision.h"
+#include "Labs/3-FEM/EmbeddedMesh.h"
+#include "Labs/3-FEM/Materials.h"
+#include "Labs/3-FEM/ModalReduction.h"
+#include "Labs/3-FEM/PolarDecomposition.h"
+#include "Labs/3-FEM/TetMesh.h"
+#include "Labs/Common/Parallel.h"
 
 
 namespace VCX::Labs::FEM {
+    enum class Integrator {
+        Explicit, // symplectic Euler with fixed substeps
+        Implicit, // backward Euler, Newton + preconditioned CG
+        ImplicitMatrixFree, // backward Euler, Newton + matrix-free PCG
+        XPBD, // position-based substeps, Neo-Hookean constraints
+        Modal, // lowest linear vibration modes, optional cubature correction
+    };
+
+    enum class Material {
+        StVK,
+        NeoHookean,
+        Linear,
+        Corotated, // linear elasticity in the frame of the per-tet rotation
+    };
+
+    enum class Preconditioner {
+        Jacobi,
+        BlockJacobi, // 3x3 diagonal block per vertex
+    };
+
+    enum class XPBDMode {
+        GaussSeidel, // tets of one color in parallel, colors in sequence
+        Jacobi,      // all tets in parallel, corrections averaged per vertex
+    };
+
     struct Simulator {
         std::vector<glm::vec3> particlePos; // Particle Position
         std::vector<glm::vec3> particleVel; // Particle Velocity
@@ -18,7 +60,10 @@ namespace VCX::Labs::FEM {
         std::vector<glm::vec3> particlePosRest; // Particle Position
         std::vector<glm::vec3> particleVelRest; // Particle Velocity
         std::vector<glm::vec3> particleForce; // Particle Force
-        
+        std::vector<int>       particleFixed; // pinned particles
+        std::vector<glm::mat3> restDmInv;  // inverse of the rest shape matrix of each tet
+        std::vector<float>     restVolume; // rest volume of each tet
+
         int wx; // number of particles in x direction
         int wy;
         int wz;
@@ -32,40 +77,308 @@ namespace VCX::Labs::FEM {
 
         float g = 0.1f;
 
-        inline float trace(glm::mat3 const & m) {
-            return m[0][0] + m[1][1] + m[2][2];
+        Material material = Material::StVK;
+        int rotationIterations = 3;
+        std::vector<glm::vec4> tetRotationQ; // per-tet rotation, warm start of the next polar decomposition
+        std::vector<glm::mat3> tetRotation;
+        // linear K_e of each tet, through which the Rotated models are evaluated as R K_e (R^T x - X);
+        // rebuilt when the mesh, young or poison change
+        std::vector<Eigen::Matrix<float, 12, 12>> restStiffness;
+        float restStiffnessYoung = 0, restStiffnessPoison = 0;
+
+        Integrator integrator = Integrator::Explicit;
+        int   explicitSubsteps   = 20;
+        int   newtonIterations   = 3;
+        int   cgMaxIterations    = 200;
+        float cgTolerance        = 1e-4f;
+        float newtonTolerance    = 1e-5f;
+        bool  projectStiffness   = true;  // clamp negative eigenvalues of each element stiffness
+        bool  forceProjection    = false; // set while a Newton iteration is redone after a CG breakdown
+
+        bool  groundCollision    = true;
+        bool  selfCollision      = true;
+        float groundHeight       = -1.0f;
+        float groundFriction     = 0.5f;
+        float collisionThickness = 0.1f; // fraction of delta
+
+        BoundarySurface  surface;         // built once per scene, shared with the renderer
+        SurfaceBVH       bvh;             // refit every substep
+        ContactBuffer    contacts;
+        std::vector<int> surfaceVertices;
+        int              lastContactCount = 0;
+
+        EmbeddedMesh embedded; // optional dense render mesh driven by the tets
+
+        // explicit substeps follow the stability estimate unless adaptiveSubsteps is off
+        bool  adaptiveSubsteps   = true;
+        float stabilitySafety    = 0.5f;
+        int   maxSubsteps        = 200;
+        float restStiffnessBound = 0.0f; // max over vertices of the summed per-tet bound on lambda_max(K_e) / (mu + 1.5 lambda)
+        int   lastSubsteps       = 0;
+
+        // the body sleeps after sleepFrames frames with rms speed and rms residual acceleration below the thresholds
+        bool                 allowSleep        = true;
+        float                sleepVelocity     = 1e-3f; // delta per second
+        float                sleepAcceleration = 5e-2f; // delta per second^2, above the float noise of stiff materials
+        int                  sleepFrames       = 30;
+        bool                 sleeping          = false;
+        int                  settledFrames     = 0;
+        float                lastKineticEnergy = 0.0f;
+        float                lastResidualNorm  = 0.0f; // |M dv / dt|, the net force over the last frame
+        std::array<float, 7> sleepParams {};           // parameters the body fell asleep with
+        std::vector<glm::vec3> frameStartVel;
+
+        // statistics of the last implicit step; an iteration redone with the projected stiffness
+        // counts once, and its discarded solve only as a retry
+        int lastNewtonIterations  = 0;
+        int lastCGIterations      = 0;
+        int lastProjectionRetries = 0;
+
+        // implicit system M + h c I + h^2 K, its sparsity pattern is built once in buildImplicitPattern
+        Eigen::SparseMatrix<float>                                        implicitMatrix;
+        std::vector<int>                                                  implicitTetSlots;  // 144 value offsets per tet
+        std::vector<int>                                                  implicitDiagSlots; // value offset of each diagonal
+        Eigen::ConjugateGradient<Eigen::SparseMatrix<float>, Eigen::Lower | Eigen::Upper> implicitSolver;
+
+        // matrix-free solver state, all sized by vertex or tet count
+        Preconditioner preconditioner = Preconditioner::BlockJacobi;
+        bool warmStart = true;
+        std::vector<int> vertexTetOffsets; // CSR: incident (tet, local vertex) pairs of each vertex
+        std::vector<int> vertexTetEntries; // tet * 4 + local vertex
+        struct MatrixFreeWorkspace {
+            std::vector<glm::mat3> F;        // deformation gradient of each tet
+            std::vector<glm::mat3> H;        // per-tet nodal vectors 1..3, node 0 is minus their sum
+            std::vector<glm::mat3> precond;  // inverse diagonal block of each vertex
+            std::vector<glm::vec3> x0, v0, fExt, b, dv, dvPrev, r, z, p, Ap;
+        } mf;
+
+        // XPBD with the deviatoric and hydrostatic constraints of Macklin and Mueller 2021,
+        // one projection per substep ("small steps")
+        XPBDMode xpbdMode       = XPBDMode::GaussSeidel;
+        int      xpbdSubsteps   = 10;
+        float    xpbdRelaxation = 1.5f; // scales the averaged Jacobi corrections
+        struct XPBDWorkspace {
+            std::vector<glm::vec3> correction;   // constraint displacement of each particle in the current substep
+            std::vector<glm::vec3> delta;        // four corrections per tet, Jacobi only
+            std::vector<int>       colorOffsets; // tets sorted by color, no two in a color share a vertex
+            std::vector<int>       colorTets;
+        } xpbd;
+
+        // reduced-order simulation in the span of the lowest modes of the rest stiffness; the basis
+        // is computed on first use (or read from the disk cache) and kept until the scene changes
+        int  modalCount       = 24;
+        bool  modalCubature     = false; // add the nonlinear part of the selected material from a few weighted tets
+        int   cubatureTetCount  = 256;   // at most this many tets carry the fitted weights
+        float cubatureTolerance = 0.01f; // relative error of the fit at which fewer tets suffice
+        struct ModalState {
+            ModalBasis       basis;
+            int              count = 0;            // parameters the basis was built with
+            float            poison = 0, mass = 0;
+            Eigen::VectorXf  gravityLoad;          // Phi^T of the gravity load for g = 1
+            Eigen::VectorXf  force;                // reduced force of the current step
+            Eigen::MatrixXf  state;                // k x 2, reduced displacement and velocity
+            Eigen::MatrixXf  full;                 // 3n x 2, Phi state
+            CubatureRule     cubature;
+            std::uint64_t    cubatureBasis = 0;    // basis key, material and settings the rule was fitted for
+            Material         cubatureMaterial = Material::Linear;
+            int              cubatureSamples = 0;
+            float            cubatureTolerance = 0;
+            bool             stale = true;         // state has to be projected from the particles
+        } modal;
+
+        inline float lameLambda() const {
+            return young * poison / ((1 + poison) * (1 - 2 * poison));
+        }
+
+        inline float lameMu() const {
+            return young / (2 * (1 + poison));
+        }
+
+        inline LameParameters lameParameters() const {
+            return { lameLambda(), lameMu() };
+        }
+
+        // calls func with a value of the policy type of the current material; everything below
+        // that call is instantiated per model
+        template<typename Func>
+        decltype(auto) dispatchMaterial(Func && func) {
+            switch(material)
+            {
+            case Material::NeoHookean: return func(NeoHookeanMaterial {});
+            case Material::Linear:     return func(LinearMaterial {});
+            case Material::Corotated:  return func(CorotatedMaterial {});
+            default:                   return func(StVKMaterial {});
+            }
+        }
+
+        void precomputeRest() {
+            restDmInv.resize(tet.size());
+            restVolume.resize(tet.size());
+            for(int i=0; i<tet.size(); i++)
+            {
+                glm::mat3 Ds_rest = glm::mat3(particlePosRest[tet[i][1]] - particlePosRest[tet[i][0]],
+                                              particlePosRest[tet[i][2]] - particlePosRest[tet[i][0]],
+                                              particlePosRest[tet[i][3]] - particlePosRest[tet[i][0]]);
+                restDmInv[i]  = glm::inverse(Ds_rest);
+                restVolume[i] = abs(glm::determinant(Ds_rest)) / 6.0f;
+            }
+
+            // psi <= (mu + 1.5 lambda) |grad u|^2 and |grad u|^2 <= |u|^2 sum_a |grad N_a|^2, so
+            // lambda_max(K_e) <= 2 V (mu + 1.5 lambda) sum_a |grad N_a|^2; summing the tets around
+            // each vertex bounds lambda_max(K) from above
+            std::vector<float> vertexBound(particlePosRest.size(), 0.0f);
+            for(int i=0; i<tet.size(); i++)
+            {
+                glm::mat3 const & DmInv = restDmInv[i];
+                glm::vec3 const grad0 = -(glm::transpose(DmInv) * glm::vec3(1.0f)); // minus the sum of the rows
+                float const gradSq = glm::dot(DmInv[0], DmInv[0]) + glm::dot(DmInv[1], DmInv[1]) + glm::dot(DmInv[2], DmInv[2]) + glm::dot(grad0, grad0);
+                for(int j=0; j<4; j++)
+                    vertexBound[tet[i][j]] += 2.0f * restVolume[i] * gradSq;
+            }
+            restStiffnessBound = 0.0f;
+            for(float const b : vertexBound) restStiffnessBound = std::max(restStiffnessBound, b);
         }
 
-        std::vector<glm::vec3> computeForceTet(const int tetId) {
+        inline glm::mat3 deformationGradient(const int tetId) {
             glm::vec3 x0 = particlePos[tet[tetId][0]];
             glm::vec3 x1 = particlePos[tet[tetId][1]];
             glm::vec3 x2 = particlePos[tet[tetId][2]];
             glm::vec3 x3 = particlePos[tet[tetId][3]];
 
             glm::mat3 Ds = glm::mat3(x1 - x0, x2 - x0, x3 - x0);
+            return Ds * restDmInv[tetId];
+        }
+
+        template<typename Model>
+        inline glm::mat3 tetRotationOf(const int tetId) const {
+            if constexpr (Model::Rotated) return tetRotation[tetId];
+            else return glm::mat3(1.0f);
+        }
+
+        // nodal vectors 1..3 of K_e u for the displacement u = (0, D) of the nodes; K_e ignores
+        // translations, so holding node 0 in place loses nothing
+        inline glm::mat3 restStiffnessProduct(const int tetId, glm::mat3 const & D) const {
+            Eigen::Map<Eigen::Matrix<float, 9, 1> const> const u(&D[0][0]);
+            Eigen::Matrix<float, 9, 1> const k = restStiffness[tetId].bottomRightCorner<9, 9>() * u;
+            return glm::mat3(glm::vec3(k[0], k[1], k[2]), glm::vec3(k[3], k[4], k[5]), glm::vec3(k[6], k[7], k[8]));
+        }
+
+        // elastic forces on nodes 1..3 as columns, node 0 is minus their sum
+        template<typename Model>
+        inline glm::mat3 computeForceTet(const int tetId, glm::mat3 const & F, LameParameters const & lame) {
+            if constexpr (Model::Rotated)
+            {
+                // f = -R K_e (R^T x - X), the node displacements relative to node 0 are R^T F Dm - Dm
+                glm::mat3 const & R = tetRotation[tetId];
+                glm::vec3 const X0 = particlePosRest[tet[tetId][0]];
+                glm::mat3 const Dm(particlePosRest[tet[tetId][1]] - X0, particlePosRest[tet[tetId][2]] - X0, particlePosRest[tet[tetId][3]] - X0);
+                return -(R * restStiffnessProduct(tetId, glm::transpose(R) * F * Dm - Dm));
+            }
+            glm::mat3 P = Model::Stress(F, tetRotationOf<Model>(tetId), lame);
+            return -restVolume[tetId] * P * glm::transpose(restDmInv[tetId]);
+        }
+
+        // K dx on nodes 1..3 for a change dDs of the shape matrix, node 0 is minus their sum
+        template<typename Model>
+        inline glm::mat3 stiffnessProductTet(const int tetId, glm::mat3 const & F, glm::mat3 const & dDs, LameParameters const & lame) {
+            if constexpr (Model::Rotated)
+            {
+                glm::mat3 const & R = tetRotation[tetId];
+                return R * restStiffnessProduct(tetId, glm::transpose(R) * dDs);
+            }
+            glm::mat3 dF = dDs * restDmInv[tetId];
+            glm::mat3 dP = Model::StressDifferential(F, tetRotationOf<Model>(tetId), dF, lame);
+            return restVolume[tetId] * dP * glm::transpose(restDmInv[tetId]);
+        }
+
+        // K = -df/dx of a tet at deformation F, columns ordered as (vertex, axis)
+        template<typename Model>
+        Eigen::Matrix<float, 12, 12> computeStiffnessTet(const int tetId, glm::mat3 const & F, LameParameters const & lame) {
+            Eigen::Matrix<float, 12, 12> K;
+            if constexpr (Model::Rotated)
+            {
+                // R K_e R^T block by block, semi-definite like K_e
+                Eigen::Matrix3f R;
+                for(int r=0; r<3; r++)
+                    for(int c=0; c<3; c++) R(r, c) = tetRotation[tetId][c][r];
+                for(int a=0; a<4; a++)
+                    for(int b=0; b<4; b++)
+                        K.block<3, 3>(3*a, 3*b).noalias() = R * restStiffness[tetId].block<3, 3>(3*a, 3*b) * R.transpose();
+                return K;
+            }
+            for(int a=0; a<4; a++)
+            {
+                for(int c=0; c<3; c++)
+                {
+                    glm::mat3 dDs(0.0f);
+                    for(int k=0; k<3; k++)
+                    {
+                        if(a == 0) dDs[k][c] = -1.0f;
+                        else if(a == k + 1) dDs[k][c] = 1.0f;
+                    }
+                    glm::mat3 dH = stiffnessProductTet<Model>(tetId, F, dDs, lame);
+                    glm::vec3 dH0 = -dH[0] - dH[1] - dH[2];
+                    for(int r=0; r<3; r++)
+                    {
+                        K(r, 3*a+c) = dH0[r];
+                        for(int k=0; k<3; k++)
+                            K(3*(k+1)+r, 3*a+c) = dH[k][r];
+                    }
+                }
+            }
+            K = 0.5f * (K + K.transpose());
+            // the linear stiffness is semi-definite already
+            if((projectStiffness || forceProjection) && !std::is_same_v<Model, LinearMaterial>)
+            {
+                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<float, 12, 12>> eig(K);
+                Eigen::Matrix<float, 12, 1> lambdas = eig.eigenvalues().cwiseMax(0.0f);
+                K = eig.eigenvectors() * lambdas.asDiagonal() * eig.eigenvectors().transpose();
+            }
+            return K;
+        }
 
-            glm::mat3 Ds_rest = glm::mat3(particlePosRest[tet[tetId][1]] - particlePosRest[tet[tetId][0]],
-                                          particlePosRest[tet[tetId][2]] - particlePosRest[tet[tetId][0]],
-                                          particlePosRest[tet[tetId][3]] - particlePosRest[tet[tetId][0]]);
-            glm::mat3 F = Ds * glm::inverse(Ds_rest);
-            float lambda = young * poison / ((1 + poison) * (1 - 2 * poison));
-            float mu = young / (2 * (1 + poison));
-            glm::mat3 G = 0.5f*(glm::transpose(F) * F - glm::mat3(1.0f));   // Green-Lagrange Strain
-            glm::mat3 S = 2 * mu * G + lambda * trace(G) * glm::mat3(1.0f); // Cauchy Stress
+        void updateRotations() {
+            if(tetRotationQ.size() != tet.size())
+            {
+                tetRotationQ.assign(tet.size(), glm::vec4(0, 0, 0, 1));
+                tetRotation.assign(tet.size(), glm::mat3(1.0f));
+            }
+            Common::ParallelFor(0, tet.size(), [&](std::size_t const i) {
+                tetRotation[i] = ExtractRotation(deformationGradient(int(i)), tetRotationQ[i], rotationIterations);
+            });
+        }
 
-            float V_rest = abs(glm::determinant(Ds_rest)) / 6.0f;
+        // linear elasticity is StVK linearized at the rest shape, so K_e only has to be rebuilt when the parameters move
+        void prepareRestStiffness() {
+            if(restStiffness.size() == tet.size() && restStiffnessYoung == young && restStiffnessPoison == poison) return;
+            LameParameters const lame = lameParameters();
+            restStiffness.resize(tet.size());
+            Common::ParallelFor(0, tet.size(), [&](std::size_t const i) {
+                restStiffness[i] = computeStiffnessTet<LinearMaterial>(int(i), glm::mat3(1.0f), lame);
+            }, 64);
+            restStiffnessYoung = young;
+            restStiffnessPoison = poison;
+        }
 
-            glm::mat3 force = -V_rest * F * S * glm::transpose(glm::inverse(Ds_rest)) ;
-            glm::vec3 f1 = force[0];
-            glm::vec3 f2 = force[1];
-            glm::vec3 f3 = force[2];
-            glm::vec3 f0 = -f1 - f2 - f3;
+        // called once per force evaluation, before any per-tet kernel
+        template<typename Model>
+        void prepareMaterial() {
+            if constexpr (Model::Rotated)
+            {
+                prepareRestStiffness();
+                updateRotations();
+            }
+        }
 
-            return {f0, f1, f2, f3};
+        void SimulateSubstep(float const dt) {
+            dispatchMaterial([&](auto model) { SimulateSubstep<decltype(model)>(dt); });
         }
 
+        template<typename Model>
         void SimulateSubstep(float const dt) {
             glm::vec3 gravity { 0, -g, 0 };
+            LameParameters const lame = lameParameters();
+            prepareMaterial<Model>();
 
             for(int i=0; i<particlePos.size(); i++)
             {
@@ -76,10 +389,11 @@ namespace VCX::Labs::FEM {
 
             for(int i=0; i<tet.size(); i++)
             {
-                std::vector<glm::vec3> force = computeForceTet(i);
-                for(int j=0; j<4; j++)
+                glm::mat3 force = computeForceTet<Model>(i, deformationGradient(i), lame);
+                particleForce[tet[i][0]] -= force[0] + force[1] + force[2];
+                for(int j=1; j<4; j++)
                 {
-                    particleForce[tet[i][j]] += force[j];
+                    particleForce[tet[i][j]] += force[j - 1];
                 }
             }
 
@@ -100,15 +414,903 @@ namespace VCX::Labs::FEM {
             {
                 particleForce[i] = {0, 0, 0};
             }
+
+            handleCollisions();
+        }
+
+
+        void buildImplicitPattern() {
+            const int nDoFs = int(particlePos.size()) * 3;
+            std::vector<Eigen::Triplet<float>> coefficients;
+            coefficients.reserve(tet.size() * 144 + nDoFs);
+            for(int i=0; i<nDoFs; i++) coefficients.emplace_back(i, i, 0.0f);
+            for(int i=0; i<tet.size(); i++)
+                for(int a=0; a<4; a++)
+                    for(int b=0; b<4; b++)
+                        for(int r=0; r<3; r++)
+                            for(int c=0; c<3; c++)
+                                coefficients.emplace_back(3*tet[i][a]+r, 3*tet[i][b]+c, 0.0f);
+
+            implicitMatrix.resize(nDoFs, nDoFs);
+            implicitMatrix.setFromTriplets(coefficients.begin(), coefficients.end());
+            implicitMatrix.makeCompressed();
+
+            const auto slot = [&](int const row, int const col) {
+                const int * begin = implicitMatrix.innerIndexPtr() + implicitMatrix.outerIndexPtr()[col];
+                const int * end   = implicitMatrix.innerIndexPtr() + implicitMatrix.outerIndexPtr()[col + 1];
+                return int(std::lower_bound(begin, end, row) - implicitMatrix.innerIndexPtr());
+            };
+
+            implicitDiagSlots.resize(nDoFs);
+            for(int i=0; i<nDoFs; i++) implicitDiagSlots[i] = slot(i, i);
+
+            implicitTetSlots.resize(tet.size() * 144);
+            for(int i=0; i<tet.size(); i++)
+                for(int a=0; a<4; a++)
+                    for(int b=0; b<4; b++)
+                        for(int r=0; r<3; r++)
+                            for(int c=0; c<3; c++)
+                                implicitTetSlots[i*144 + (3*a+r)*12 + 3*b+c] = slot(3*tet[i][a]+r, 3*tet[i][b]+c);
+
+            implicitSolver.analyzePattern(implicitMatrix);
+        }
+
+        // backward Euler in velocity form: M(v - v_n) = h f(x_n + h v), solved by Newton's method
+        void SimulateImplicitStep(float const h) {
+            dispatchMaterial([&](auto model) { SimulateImplicitStep<decltype(model)>(h); });
+        }
+
+        template<typename Model>
+        void SimulateImplicitStep(float const h) {
+            LameParameters const lame = lameParameters();
+            const int nParticles = int(particlePos.size());
+            const int nDoFs = nParticles * 3;
+            if(implicitMatrix.rows() != nDoFs) buildImplicitPattern();
+
+            glm::vec3 gravity { 0, -g, 0 };
+            std::vector<glm::vec3> x0(particlePos);
+            std::vector<glm::vec3> v0(particleVel);
+            std::vector<glm::vec3> fExt(nParticles);
+            for(int i=0; i<nParticles; i++)
+                fExt[i] = gravity * particle_weight + particleForce[i];
+
+            Eigen::VectorXf rhs(nDoFs);
+            Eigen::VectorXf dv(nDoFs);
+            implicitSolver.setMaxIterations(cgMaxIterations);
+            implicitSolver.setTolerance(cgTolerance);
+
+            lastNewtonIterations = 0;
+            lastCGIterations = 0;
+            lastProjectionRetries = 0;
+            for(int it=0; it<newtonIterations; it++)
+            {
+                for(int i=0; i<nParticles; i++)
+                    particlePos[i] = x0[i] + h * particleVel[i];
+                prepareMaterial<Model>();
+
+                // assemble the system in place over the fixed pattern
+                float * values = implicitMatrix.valuePtr();
+                std::fill(values, values + implicitMatrix.nonZeros(), 0.0f);
+                for(int i=0; i<nDoFs; i++) values[implicitDiagSlots[i]] = particle_weight + h * friction;
+
+                std::vector<glm::vec3> fInt(nParticles, {0, 0, 0});
+                for(int i=0; i<tet.size(); i++)
+                {
+                    glm::mat3 const F = deformationGradient(i);
+                    glm::mat3 force = computeForceTet<Model>(i, F, lame);
+                    fInt[tet[i][0]] -= force[0] + force[1] + force[2];
+                    for(int j=1; j<4; j++)
+                        fInt[tet[i][j]] += force[j - 1];
+
+                    Eigen::Matrix<float, 12, 12> K = computeStiffnessTet<Model>(i, F, lame);
+                    for(int a=0; a<4; a++)
+                    {
+                        if(is_fixed(tet[i][a])) continue;
+                        for(int b=0; b<4; b++)
+                        {
+                            if(is_fixed(tet[i][b])) continue;
+                            for(int r=0; r<3; r++)
+                                for(int c=0; c<3; c++)
+                                    values[implicitTetSlots[i*144 + (3*a+r)*12 + 3*b+c]] += h * h * K(3*a+r, 3*b+c);
+                        }
+                    }
+                }
+
+                for(int i=0; i<nParticles; i++)
+                {
+                    glm::vec3 r = is_fixed(i) ? glm::vec3(0.0f)
+                        : h * (fInt[i] + fExt[i] - friction * particleVel[i]) - particle_weight * (particleVel[i] - v0[i]);
+                    for(int j=0; j<3; j++) rhs[3*i+j] = r[j];
+                }
+
+                if(rhs.norm() < newtonTolerance * particle_weight * std::sqrt(float(nDoFs)))
+                {
+                    lastNewtonIterations++;
+                    break;
+                }
+
+                implicitSolver.factorize(implicitMatrix);
+                dv = implicitSolver.solve(rhs);
+                // The unprojected StVK tangent can be indefinite under compression and break CG down.
+                // The iteration is then redone with the projected element stiffness; a projected solve
+                // that stopped early is still a descent direction, only a non-finite one is dropped and
+                // the velocities of the last good iterate are kept.
+                bool const projected = projectStiffness || forceProjection || Model::Rotated || std::is_same_v<Model, LinearMaterial>;
+                if(!dv.allFinite() || (implicitSolver.info() != Eigen::Success && !projected))
+                {
+                    if(projected) break;
+                    forceProjection = true;
+                    lastProjectionRetries++;
+                    it--;
+                    continue;
+                }
+                lastNewtonIterations++;
+                lastCGIterations += int(implicitSolver.iterations());
+
+                for(int i=0; i<nParticles; i++)
+                    if(!is_fixed(i))
+                        particleVel[i] += glm::vec3(dv[3*i], dv[3*i+1], dv[3*i+2]);
+            }
+
+            forceProjection = false;
+
+            for(int i=0; i<nParticles; i++)
+            {
+                particlePos[i] = x0[i] + h * particleVel[i];
+                particleForce[i] = {0, 0, 0};
+            }
+            handleCollisions();
+        }
+
+        void buildVertexTetAdjacency() {
+            vertexTetOffsets.assign(particlePos.size() + 1, 0);
+            for(int i=0; i<tet.size(); i++)
+                for(int j=0; j<4; j++)
+                    vertexTetOffsets[tet[i][j] + 1]++;
+            for(int i=0; i<particlePos.size(); i++)
+                vertexTetOffsets[i + 1] += vertexTetOffsets[i];
+            vertexTetEntries.resize(tet.size() * 4);
+            std::vector<int> cursor(vertexTetOffsets.begin(), vertexTetOffsets.end() - 1);
+            for(int i=0; i<tet.size(); i++)
+                for(int j=0; j<4; j++)
+                    vertexTetEntries[cursor[tet[i][j]]++] = i * 4 + j;
+        }
+
+        // out[v] = sum of the nodal vectors of all tets around v, no atomics needed
+        void gatherTetVectors(std::vector<glm::mat3> const & H, std::vector<glm::vec3> & out) {
+            Common::ParallelFor(0, particlePos.size(), [&](std::size_t const v) {
+                glm::vec3 sum(0.0f);
+                for(int k=vertexTetOffsets[v]; k<vertexTetOffsets[v + 1]; k++)
+                {
+                    glm::mat3 const & h = H[vertexTetEntries[k] / 4];
+                    int const local = vertexTetEntries[k] % 4;
+                    sum += local == 0 ? -h[0] - h[1] - h[2] : h[local - 1];
+                }
+                out[v] = sum;
+            });
+        }
+
+        // caches F of every tet at the current positions and writes the elastic forces to out
+        template<typename Model>
+        void updateTetStress(std::vector<glm::vec3> & out) {
+            LameParameters const lame = lameParameters();
+            prepareMaterial<Model>();
+            Common::ParallelFor(0, tet.size(), [&](std::size_t const i) {
+                mf.F[i] = deformationGradient(int(i));
+                mf.H[i] = computeForceTet<Model>(int(i), mf.F[i], lame);
+            });
+            gatherTetVectors(mf.H, out);
+        }
+
+        // Ap = (M + h c I + h^2 K) p with K applied element by element
+        template<typename Model>
+        void applyImplicitOperator(float const h, std::vector<glm::vec3> const & p, std::vector<glm::vec3> & Ap) {
+            LameParameters const lame = lameParameters();
+            Common::ParallelFor(0, tet.size(), [&](std::size_t const i) {
+                glm::vec3 const p0 = p[tet[i][0]];
+                glm::mat3 dDs(p[tet[i][1]] - p0, p[tet[i][2]] - p0, p[tet[i][3]] - p0);
+                mf.H[i] = stiffnessProductTet<Model>(int(i), mf.F[i], dDs, lame);
+            });
+            gatherTetVectors(mf.H, Ap);
+            float const diag = particle_weight + h * friction;
+            Common::ParallelFor(0, particlePos.size(), [&](std::size_t const v) {
+                Ap[v] = is_fixed(int(v)) ? diag * p[v] : diag * p[v] + h * h * Ap[v];
+            });
+        }
+
+        template<typename Model>
+        void buildImplicitPreconditioner(float const h) {
+            LameParameters const lame = lameParameters();
+            float const diag = particle_weight + h * friction;
+            Common::ParallelFor(0, particlePos.size(), [&](std::size_t const v) {
+                glm::mat3 block(diag);
+                if(!is_fixed(int(v)))
+                {
+                    for(int k=vertexTetOffsets[v]; k<vertexTetOffsets[v + 1]; k++)
+                    {
+                        int const i = vertexTetEntries[k] / 4;
+                        int const local = vertexTetEntries[k] % 4;
+                        glm::mat3 const DmInvT = glm::transpose(restDmInv[i]);
+                        glm::vec3 const grad = local == 0 ? -DmInvT[0] - DmInvT[1] - DmInvT[2] : DmInvT[local - 1];
+                        for(int c=0; c<3; c++)
+                        {
+                            glm::vec3 e(0.0f);
+                            e[c] = 1.0f;
+                            glm::mat3 dF = glm::outerProduct(e, grad);
+                            glm::mat3 dP = Model::StressDifferential(mf.F[i], tetRotationOf<Model>(i), dF, lame);
+                            block[c] += h * h * restVolume[i] * (dP * grad);
+                        }
+                    }
+                }
+                if(preconditioner == Preconditioner::BlockJacobi && glm::determinant(block) > 0.0f)
+                {
+                    mf.precond[v] = glm::inverse(block);
+                }
+                else
+                {
+                    mf.precond[v] = glm::mat3(0.0f);
+                    for(int c=0; c<3; c++) mf.precond[v][c][c] = 1.0f / std::max(block[c][c], diag);
+                }
+            });
+        }
+
+        // solves A dv = b by PCG starting from the current dv, returns the iteration count
+        template<typename Model>
+        int solveMatrixFreePCG(float const h) {
+            std::size_t const n = particlePos.size();
+            const auto dot = [&](std::vector<glm::vec3> const & a, std::vector<glm::vec3> const & b) {
+                return Common::ParallelSum(0, n, 0.0, [&](std::size_t const i) { return double(glm::dot(a[i], b[i])); });
+            };
+
+            applyImplicitOperator<Model>(h, mf.dv, mf.Ap);
+            Common::ParallelFor(0, n, [&](std::size_t const i) {
+                mf.r[i] = mf.b[i] - mf.Ap[i];
+                mf.z[i] = mf.precond[i] * mf.r[i];
+                mf.p[i] = mf.z[i];
+            });
+            double const bNorm2 = dot(mf.b, mf.b);
+            double const threshold = double(cgTolerance) * double(cgTolerance) * std::max(bNorm2, 1e-30);
+            double rz = dot(mf.r, mf.z);
+            if(dot(mf.r, mf.r) <= threshold) return 0;
+
+            int it = 0;
+            while(it < cgMaxIterations)
+            {
+                it++;
+                applyImplicitOperator<Model>(h, mf.p, mf.Ap);
+                double const pAp = dot(mf.p, mf.Ap);
+                if(pAp <= 0.0) break;
+                float const alpha = float(rz / pAp);
+                Common::ParallelFor(0, n, [&](std::size_t const i) {
+                    mf.dv[i] += alpha * mf.p[i];
+                    mf.r[i] -= alpha * mf.Ap[i];
+                    mf.z[i] = mf.precond[i] * mf.r[i];
+                });
+                if(dot(mf.r, mf.r) <= threshold) break;
+                double const rzNew = dot(mf.r, mf.z);
+                float const beta = float(rzNew / rz);
+                rz = rzNew;
+                Common::ParallelFor(0, n, [&](std::size_t const i) {
+                    mf.p[i] = mf.z[i] + beta * mf.p[i];
+                });
+            }
+            return it;
+        }
+
+        // same Newton iteration as SimulateImplicitStep, but K is never assembled
+        void SimulateMatrixFreeStep(float const h) {
+            dispatchMaterial([&](auto model) { SimulateMatrixFreeStep<decltype(model)>(h); });
         }
 
+        template<typename Model>
+        void SimulateMatrixFreeStep(float const h) {
+            std::size_t const n = particlePos.size();
+            if(vertexTetOffsets.size() != n + 1) buildVertexTetAdjacency();
+            if(mf.x0.size() != n || mf.F.size() != tet.size())
+            {
+                mf.F.resize(tet.size());
+                mf.H.resize(tet.size());
+                for(auto * buffer : {&mf.x0, &mf.v0, &mf.fExt, &mf.b, &mf.dv, &mf.r, &mf.z, &mf.p, &mf.Ap})
+                    buffer->resize(n);
+                mf.precond.resize(n);
+                mf.dvPrev.assign(n, {0, 0, 0});
+            }
+
+            glm::vec3 gravity { 0, -g, 0 };
+            mf.x0 = particlePos;
+            mf.v0 = particleVel;
+            for(std::size_t i=0; i<n; i++)
+                mf.fExt[i] = gravity * particle_weight + particleForce[i];
+
+            lastNewtonIterations = 0;
+            lastCGIterations = 0;
+            lastProjectionRetries = 0;
+            for(int it=0; it<newtonIterations; it++)
+            {
+                Common::ParallelFor(0, n, [&](std::size_t const i) {
+                    particlePos[i] = mf.x0[i] + h * particleVel[i];
+                });
+                updateTetStress<Model>(mf.b);
+                Common::ParallelFor(0, n, [&](std::size_t const i) {
+                    mf.b[i] = is_fixed(int(i)) ? glm::vec3(0.0f)
+                        : h * (mf.b[i] + mf.fExt[i] - friction * particleVel[i]) - particle_weight * (particleVel[i] - mf.v0[i]);
+                });
+
+                lastNewtonIterations++;
+                double const residual = Common::ParallelSum(0, n, 0.0, [&](std::size_t const i) { return double(glm::dot(mf.b[i], mf.b[i])); });
+                if(std::sqrt(residual) < newtonTolerance * particle_weight * std::sqrt(float(3 * n))) break;
+
+                buildImplicitPreconditioner<Model>(h);
+                // the first solve starts from last frame's velocity change, later ones from zero
+                if(warmStart && it == 0) mf.dv = mf.dvPrev;
+                else std::fill(mf.dv.begin(), mf.dv.end(), glm::vec3(0.0f));
+                lastCGIterations += solveMatrixFreePCG<Model>(h);
+
+                for(std::size_t i=0; i<n; i++)
+                    if(!is_fixed(int(i)))
+                        particleVel[i] += mf.dv[i];
+            }
+
+            for(std::size_t i=0; i<n; i++)
+            {
+                particlePos[i] = mf.x0[i] + h * particleVel[i];
+                mf.dvPrev[i] = particleVel[i] - mf.v0[i];
+                particleForce[i] = {0, 0, 0};
+            }
+            handleCollisions();
+        }
+
+        // greedy coloring, each tet takes the smallest color not used by a tet sharing one of its vertices
+        void buildTetColoring() {
+            if(vertexTetOffsets.size() != particlePos.size() + 1) buildVertexTetAdjacency();
+            std::vector<int> color(tet.size(), -1);
+            std::vector<int> stamp;
+            int nColors = 0;
+            for(int i=0; i<tet.size(); i++)
+            {
+                for(int j=0; j<4; j++)
+                {
+                    int const v = tet[i][j];
+                    for(int k=vertexTetOffsets[v]; k<vertexTetOffsets[v + 1]; k++)
+                    {
+                        int const c = color[vertexTetEntries[k] / 4];
+                        if(c >= 0) stamp[c] = i;
+                    }
+                }
+                int c = 0;
+                while(c < nColors && stamp[c] == i) c++;
+                if(c == nColors)
+                {
+                    nColors++;
+                    stamp.push_back(-1);
+                }
+                color[i] = c;
+            }
+            xpbd.colorOffsets.assign(nColors + 1, 0);
+            for(int const c : color) xpbd.colorOffsets[c + 1]++;
+            for(int c=0; c<nColors; c++) xpbd.colorOffsets[c + 1] += xpbd.colorOffsets[c];
+            xpbd.colorTets.resize(tet.size());
+            std::vector<int> cursor(xpbd.colorOffsets.begin(), xpbd.colorOffsets.end() - 1);
+            for(int i=0; i<tet.size(); i++) xpbd.colorTets[cursor[color[i]]++] = i;
+        }
+
+        // projects the deviatoric and then the hydrostatic constraint of a tet on its four nodes
+        // at x and returns the corrections in dx. They are kept apart from the positions because
+        // at small substeps they are only a few ulps of the coordinates.
+        inline void projectTetXPBD(const int tetId, glm::vec3 const (&x)[4], glm::vec3 (&dx)[4], float const h2, LameParameters const & lame) {
+            float w[4];
+            for(int a=0; a<4; a++) w[a] = is_fixed(tet[tetId][a]) ? 0.0f : 1.0f / particle_weight;
+            glm::mat3 const & DmInv = restDmInv[tetId];
+            glm::mat3 const DmInvT = glm::transpose(DmInv);
+            bool const hydrostatic = lame.Lambda > 0.0f;
+            float const gamma = hydrostatic ? 1.0f + lame.Mu / lame.Lambda : 1.0f;
+            for(int a=0; a<4; a++) dx[a] = glm::vec3(0.0f);
+
+            for(int pass=0; pass<(hydrostatic ? 2 : 1); pass++)
+            {
+                glm::mat3 const Ds(x[1] - x[0] + (dx[1] - dx[0]), x[2] - x[0] + (dx[2] - dx[0]), x[3] - x[0] + (dx[3] - dx[0]));
+                glm::mat3 const F = Ds * DmInv;
+                float C;
+                glm::mat3 dCdF;
+                float alpha;
+                if(pass == 0)
+                {
+                    C = std::sqrt(DoubleContraction(F, F));
+                    if(C < 1e-8f) continue;
+                    dCdF = F / C;
+                    alpha = 1.0f / (lame.Mu * restVolume[tetId] * h2);
+                }
+                else
+                {
+                    C = glm::determinant(F) - gamma;
+                    dCdF = Cofactor(F);
+                    alpha = 1.0f / (lame.Lambda * restVolume[tetId] * h2);
+                }
+                glm::mat3 const grad = dCdF * DmInvT;
+                glm::vec3 const grad0 = -grad[0] - grad[1] - grad[2];
+                float const denom = w[0] * glm::dot(grad0, grad0) + w[1] * glm::dot(grad[0], grad[0])
+                    + w[2] * glm::dot(grad[1], grad[1]) + w[3] * glm::dot(grad[2], grad[2]) + alpha;
+                if(denom < 1e-20f) continue;
+                float const dLambda = -C / denom;
+                dx[0] += w[0] * dLambda * grad0;
+                for(int a=1; a<4; a++) dx[a] += w[a] * dLambda * grad[a - 1];
+            }
+        }
+
+        void SimulateXPBDStep(float const dt) {
+            std::size_t const n = particlePos.size();
+            if(xpbd.colorTets.size() != tet.size()) buildTetColoring();
+            xpbd.correction.resize(n);
+            if(xpbdMode == XPBDMode::Jacobi) xpbd.delta.resize(tet.size() * 4);
+
+            int const subSteps = std::max(1, xpbdSubsteps);
+            float const h = dt / subSteps;
+            float const h2 = h * h;
+            float const damping = 1.0f / (1.0f + h * friction / particle_weight);
+            LameParameters const lame = lameParameters();
+            glm::vec3 const gravity { 0, -g, 0 };
+            lastSubsteps = subSteps;
+
+            for(int step=0; step<subSteps; step++)
+            {
+                Common::ParallelFor(0, n, [&](std::size_t const i) {
+                    xpbd.correction[i] = glm::vec3(0.0f);
+                    if(is_fixed(int(i))) return;
+                    particleVel[i] += h * (gravity + particleForce[i] / particle_weight);
+                    particlePos[i] += h * particleVel[i];
+                });
+
+                if(xpbdMode == XPBDMode::GaussSeidel)
+                {
+                    for(std::size_t c=0; c + 1<xpbd.colorOffsets.size(); c++)
+                    {
+                        Common::ParallelFor(xpbd.colorOffsets[c], xpbd.colorOffsets[c + 1], [&](std::size_t const k) {
+                            int const i = xpbd.colorTets[k];
+                            glm::vec3 x[4], dx[4];
+                            for(int a=0; a<4; a++) x[a] = particlePos[tet[i][a]];
+                            projectTetXPBD(i, x, dx, h2, lame);
+                            for(int a=0; a<4; a++)
+                            {
+                                particlePos[tet[i][a]] += dx[a];
+                                xpbd.correction[tet[i][a]] += dx[a];
+                            }
+                        }, 64);
+                    }
+                }
+                else
+                {
+                    Common::ParallelFor(0, tet.size(), [&](std::size_t const i) {
+                        glm::vec3 x[4], dx[4];
+                        for(int a=0; a<4; a++) x[a] = particlePos[tet[i][a]];
+                        projectTetXPBD(int(i), x, dx, h2, lame);
+                        for(int a=0; a<4; a++) xpbd.delta[i * 4 + a] = dx[a];
+                    }, 64);
+                    Common::ParallelFor(0, n, [&](std::size_t const v) {
+                        int const count = vertexTetOffsets[v + 1] - vertexTetOffsets[v];
+                        if(count == 0) return;
+                        glm::vec3 sum(0.0f);
+                        for(int k=vertexTetOffsets[v]; k<vertexTetOffsets[v + 1]; k++)
+                            sum += xpbd.delta[vertexTetEntries[k]];
+                        xpbd.correction[v] = (xpbdRelaxation / count) * sum;
+                        particlePos[v] += xpbd.correction[v];
+                    });
+                }
+
+                Common::ParallelFor(0, n, [&](std::size_t const i) {
+                    // (x - x_prev) / h without the cancellation of subtracting the positions
+                    particleVel[i] = is_fixed(int(i)) ? glm::vec3(0.0f) : damping * (particleVel[i] + xpbd.correction[i] / h);
+                });
+                handleCollisions();
+            }
+            std::fill(particleForce.begin(), particleForce.end(), glm::vec3(0.0f));
+        }
+
+        void buildSurface() {
+            surface.Build(particlePosRest, tet);
+            bvh.Build(surface, particlePosRest);
+            std::vector<char> onSurface(particlePos.size(), 0);
+            for(auto const v : surface.Indices) onSurface[v] = 1;
+            surfaceVertices.clear();
+            for(int i=0; i<particlePos.size(); i++)
+                if(onSurface[i]) surfaceVertices.push_back(i);
+            contacts.Reserve(surfaceVertices.size() * 4);
+        }
+
+        // ground plane and surface vertex vs. surface triangle contacts, resolved on positions and velocities
+        void handleCollisions() {
+            lastContactCount = 0;
+            if(surface.Indices.empty() || !(groundCollision || selfCollision)) return;
+            float const thickness = collisionThickness * delta;
+            bvh.Refit(surface, particlePos, thickness);
+
+            // the root box tells whether any vertex can be below the ground
+            if(groundCollision && bvh.Nodes[0].Min.y < groundHeight + thickness)
+            {
+                Common::ParallelFor(0, surfaceVertices.size(), [&](std::size_t const k) {
+                    int const v = surfaceVertices[k];
+                    if(particlePos[v].y >= groundHeight || is_fixed(v)) return;
+                    particlePos[v].y = groundHeight;
+                    glm::vec3 & vel = particleVel[v];
+                    vel.y = std::max(vel.y, 0.0f);
+                    vel.x *= 1.0f - groundFriction;
+                    vel.z *= 1.0f - groundFriction;
+                });
+            }
+            if(!selfCollision) return;
+
+            contacts.Clear();
+            Common::ParallelFor(0, surfaceVertices.size(), [&](std::size_t const k) {
+                int const v = surfaceVertices[k];
+                glm::vec3 const p = particlePos[v];
+                bvh.Query(p - glm::vec3(thickness), p + glm::vec3(thickness), [&](int const t) {
+                    std::uint32_t const * tri = &surface.Indices[3 * t];
+                    if(tri[0] == v || tri[1] == v || tri[2] == v) return;
+                    glm::vec3 const a = particlePos[tri[0]], b = particlePos[tri[1]], c = particlePos[tri[2]];
+                    glm::vec3 const bary = ClosestPointBarycentric(p, a, b, c);
+                    glm::vec3 const q = bary.x * a + bary.y * b + bary.z * c;
+                    glm::vec3 const d = p - q;
+                    if(glm::dot(d, d) >= thickness * thickness) return;
+                    glm::vec3 n = glm::cross(b - a, c - a);
+                    float const area = glm::length(n);
+                    if(area <= 0.0f) return;
+                    n /= area;
+                    contacts.Push({ v, t, bary, n, thickness - glm::dot(d, n) });
+                });
+            }, 64);
+
+            // resolved serially in a fixed order, the contacts of one vertex touch shared particles
+            int const nContacts = contacts.Size();
+            std::sort(contacts.Data.begin(), contacts.Data.begin() + nContacts, [](Contact const & x, Contact const & y) {
+                return x.Vertex != y.Vertex ? x.Vertex < y.Vertex : x.Triangle < y.Triangle;
+            });
+            for(int k=0; k<nContacts; k++)
+            {
+                Contact const & c = contacts.Data[k];
+                std::uint32_t const * tri = &surface.Indices[3 * c.Triangle];
+                float const wv = is_fixed(c.Vertex) ? 0.0f : 1.0f;
+                glm::vec3 w(0.0f);
+                for(int j=0; j<3; j++) w[j] = is_fixed(tri[j]) ? 0.0f : c.Bary[j];
+                float const denom = wv + glm::dot(w, c.Bary);
+                if(denom <= 0.0f) continue;
+
+                float const lambda = c.Depth / denom;
+                particlePos[c.Vertex] += wv * lambda * c.Normal;
+                for(int j=0; j<3; j++) particlePos[tri[j]] -= w[j] * lambda * c.Normal;
+
+                glm::vec3 vRel = particleVel[c.Vertex];
+                for(int j=0; j<3; j++) vRel -= c.Bary[j] * particleVel[tri[j]];
+                float const vn = glm::dot(vRel, c.Normal);
+                if(vn >= 0.0f) continue;
+                float const impulse = -vn / denom;
+                particleVel[c.Vertex] += wv * impulse * c.Normal;
+                for(int j=0; j<3; j++) particleVel[tri[j]] -= w[j] * impulse * c.Normal;
+            }
+            lastContactCount = nContacts;
+        }
+
+        void buildModalBasis() {
+            modal.basis = ComputeModalBasis(particlePosRest, tet, particleFixed, young, poison, particle_weight, modalCount, DefaultModalCacheDir());
+            modal.count = modalCount;
+            modal.poison = poison;
+            modal.mass = particle_weight;
+            int const k = modal.basis.GetModeCount();
+            Eigen::VectorXf load = Eigen::VectorXf::Zero(modal.basis.Modes.rows());
+            for(std::size_t i=0; i<particlePos.size(); i++) load[3 * i + 1] = -particle_weight;
+            modal.gravityLoad = modal.basis.Modes.transpose() * load;
+            modal.force.resize(k);
+            modal.state.resize(k, 2);
+            modal.full.resize(modal.basis.Modes.rows(), 2);
+            modal.stale = true;
+        }
+
+        // Phi^T of the nonlinear part f_Model - f_Linear of tet i at the displacement u (3n, stacked
+        // like the rows of Phi) from the rest shape, added to g
+        template<typename Model>
+        void addReducedNonlinearForce(int const i, Eigen::Ref<Eigen::VectorXf const> const & u, LameParameters const & lame, Eigen::Ref<Eigen::VectorXf> g) const {
+            std::array<glm::vec3, 4> x;
+            for(int a=0; a<4; a++)
+                x[a] = particlePosRest[tet[i][a]] + glm::vec3(u[3 * tet[i][a]], u[3 * tet[i][a] + 1], u[3 * tet[i][a] + 2]);
+            glm::mat3 const F = glm::mat3(x[1] - x[0], x[2] - x[0], x[3] - x[0]) * restDmInv[i];
+            glm::mat3 R(1.0f);
+            if constexpr (Model::Rotated)
+            {
+                glm::vec4 q(0, 0, 0, 1);
+                R = ExtractRotation(F, q, 20);
+            }
+            glm::mat3 const P = Model::Stress(F, R, lame) - LinearMaterial::Stress(F, glm::mat3(1.0f), lame);
+            glm::mat3 const H = -restVolume[i] * P * glm::transpose(restDmInv[i]);
+            glm::vec3 const H0 = -H[0] - H[1] - H[2];
+            Eigen::MatrixXf const & Phi = modal.basis.Modes;
+            for(int a=0; a<4; a++)
+            {
+                glm::vec3 const & f = a == 0 ? H0 : H[a - 1];
+                g.noalias() += Phi.middleRows(3 * tet[i][a], 3).transpose() * Eigen::Vector3f(f.x, f.y, f.z);
+            }
+        }
+
+        // Fits the cubature of the nonlinear force to training poses, the lowest modes displaced
+        // both ways and a few random combinations of all of them, each scaled so that its largest
+        // nodal displacement is a quarter of the extent of the body. The rows of every pose are
+        // divided by the norm of its full force, so that small and large poses count alike. Young's
+        // modulus scales all forces alike and leaves the weights unchanged. A few more random poses
+        // are held out to log the error of the rule.
+        template<typename Model>
+        void fitCubature(LameParameters const & lame) {
+            modal.cubature = {};
+            if constexpr (std::is_same_v<Model, LinearMaterial>) return;
+            else {
+                Eigen::MatrixXf const & Phi = modal.basis.Modes;
+                int const k = modal.basis.GetModeCount();
+                int const nTets = int(tet.size());
+                if(k == 0 || nTets == 0) return;
+                auto const start = std::chrono::steady_clock::now();
+
+                glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+                for(auto const & p : particlePosRest)
+                {
+                    lo = glm::min(lo, p);
+                    hi = glm::max(hi, p);
+                }
+                float const amplitude = 0.25f * glm::length(hi - lo);
+
+                int const nSingle = std::min(k, 12);
+                int const nTrain = 2 * nSingle + 8;
+                int const nPoses = nTrain + 4;
+                Eigen::MatrixXf Q = Eigen::MatrixXf::Zero(k, nPoses);
+                for(int j=0; j<nSingle; j++)
+                {
+                    Q(j, 2 * j) = 1.0f;
+                    Q(j, 2 * j + 1) = -1.0f;
+                }
+                std::mt19937 rng(4321);
+                std::normal_distribution<float> normal;
+                for(int p=2*nSingle; p<nPoses; p++)
+                    for(int j=0; j<k; j++) Q(j, p) = normal(rng);
+                Eigen::MatrixXf U = Phi * Q;
+                for(int p=0; p<nPoses; p++)
+                {
+                    float largest = 0.0f;
+                    for(Eigen::Index i=0; i<U.rows(); i+=3) largest = std::max(largest, U.col(p).segment(i, 3).norm());
+                    if(largest > 0.0f) U.col(p) *= amplitude / largest;
+                }
+
+                // the full reduced force of every pose, in parallel over the poses
+                Eigen::MatrixXf full = Eigen::MatrixXf::Zero(k, nPoses);
+                Common::ParallelFor(0, std::size_t(nPoses), [&](std::size_t const p) {
+                    for(int i=0; i<nTets; i++) addReducedNonlinearForce<Model>(i, U.col(p), lame, full.col(p));
+                }, 1);
+                Eigen::VectorXf scale(nPoses);
+                for(int p=0; p<nPoses; p++)
+                {
+                    float const norm = full.col(p).norm();
+                    scale[p] = norm > 0.0f ? 1.0f / norm : 0.0f;
+                }
+
+                // the reduced force of every tet in every training pose, one column per tet
+                Eigen::MatrixXf A = Eigen::MatrixXf::Zero(Eigen::Index(nTrain) * k, nTets);
+                Common::ParallelFor(0, std::size_t(nTets), [&](std::size_t const i) {
+                    for(int p=0; p<nTrain; p++)
+                    {
+                        auto g = A.col(Eigen::Index(i)).segment(Eigen::Index(p) * k, k);
+                        addReducedNonlinearForce<Model>(int(i), U.col(p), lame, g);
+                        g *= scale[p];
+                    }
+                }, 16);
+                Eigen::VectorXf b(Eigen::Index(nTrain) * k);
+                for(int p=0; p<nTrain; p++) b.segment(Eigen::Index(p) * k, k) = scale[p] * full.col(p);
+                modal.cubature = FitCubature(A, b, cubatureTetCount, cubatureTolerance);
+
+                float heldOut = 0.0f;
+                Eigen::VectorXf approximation(k);
+                for(int p=nTrain; p<nPoses; p++)
+                {
+                    Eigen::VectorXf g(k);
+                    approximation.setZero();
+                    for(std::size_t s=0; s<modal.cubature.Elements.size(); s++)
+                    {
+                        g.setZero();
+                        addReducedNonlinearForce<Model>(modal.cubature.Elements[s], U.col(p), lame, g);
+                        approximation += modal.cubature.Weights[s] * g;
+                    }
+                    heldOut = std::max(heldOut, (approximation - full.col(p)).norm() * scale[p]);
+                }
+                double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                spdlog::info(
+                    "VCX::Labs::FEM::Simulator::fitCubature: {} of {} tets in {:.2f} s, relative error of Phi^T f {:.2e} on {} training and {:.2e} on {} held-out modal poses.",
+                    modal.cubature.Elements.size(), nTets, seconds, modal.cubature.TrainingError, nTrain, heldOut, nPoses - nTrain);
+            }
+        }
+
+        // Phi^T of the difference between the selected material and the linear forces, summed over the cubature tets with their weights
+        template<typename Model>
+        void addCubatureForce(LameParameters const & lame) {
+            if constexpr (std::is_same_v<Model, LinearMaterial>) return;
+            else {
+                Eigen::MatrixXf const & Phi = modal.basis.Modes;
+                if constexpr (Model::Rotated) prepareRestStiffness();
+                for(std::size_t s=0; s<modal.cubature.Elements.size(); s++)
+                {
+                    int const i = modal.cubature.Elements[s];
+                    glm::mat3 const F = deformationGradient(i);
+                    if constexpr (Model::Rotated)
+                    {
+                        tetRotation[i] = ExtractRotation(F, tetRotationQ[i], rotationIterations);
+                    }
+                    glm::mat3 const H = modal.cubature.Weights[s] * (computeForceTet<Model>(i, F, lame) - computeForceTet<LinearMaterial>(i, F, lame));
+                    glm::vec3 const H0 = -H[0] - H[1] - H[2];
+                    for(int a=0; a<4; a++)
+                    {
+                        glm::vec3 const & f = a == 0 ? H0 : H[a - 1];
+                        int const row = 3 * tet[i][a];
+                        modal.force.noalias() += Phi.middleRows(row, 3).transpose() * Eigen::Vector3f(f.x, f.y, f.z);
+                    }
+                }
+            }
+        }
+
+        // Each mode is an independent oscillator q'' = f_r - omega^2 q - (c / m) q' in reduced
+        // coordinates, advanced by backward Euler on the linear part. The particles are written
+        // back with one 3n x k by k x 2 product. Collisions are not handled, contact displacements
+        // are generally outside the span of the modes.
+        void SimulateModalStep(float const dt) {
+            if(modal.basis.GetModeCount() == 0 || modal.count != modalCount || modal.poison != poison || modal.mass != particle_weight)
+                buildModalBasis();
+            int const k = modal.basis.GetModeCount();
+            if(k == 0) return;
+            std::size_t const n = particlePos.size();
+            Eigen::MatrixXf const & Phi = modal.basis.Modes;
+            Eigen::Map<Eigen::VectorXf> x(&particlePos[0].x, Eigen::Index(3 * n));
+            Eigen::Map<Eigen::VectorXf> v(&particleVel[0].x, Eigen::Index(3 * n));
+            Eigen::Map<Eigen::VectorXf const> X(&particlePosRest[0].x, Eigen::Index(3 * n));
+            Eigen::Map<Eigen::VectorXf const> f(&particleForce[0].x, Eigen::Index(3 * n));
+
+            if(modal.stale)
+            {
+                // M-orthonormal modes, so the M-projection is m Phi^T
+                modal.state.col(0).noalias() = particle_weight * (Phi.transpose() * (x - X));
+                modal.state.col(1).noalias() = particle_weight * (Phi.transpose() * v);
+                modal.stale = false;
+            }
+
+            modal.force = g * modal.gravityLoad;
+            if(std::any_of(particleForce.begin(), particleForce.end(), [](glm::vec3 const & p) { return p != glm::vec3(0.0f); }))
+                modal.force.noalias() += Phi.transpose() * f;
+            if(modalCubature)
+            {
+                LameParameters const lame = lameParameters();
+                if(modal.cubatureBasis != modal.basis.Key || modal.cubatureMaterial != material
+                    || modal.cubatureSamples != cubatureTetCount || modal.cubatureTolerance != cubatureTolerance)
+                {
+                    dispatchMaterial([&](auto model) { fitCubature<decltype(model)>(lame); });
+                    modal.cubatureBasis = modal.basis.Key;
+                    modal.cubatureMaterial = material;
+                    modal.cubatureSamples = cubatureTetCount;
+                    modal.cubatureTolerance = cubatureTolerance;
+                }
+                if(tetRotationQ.size() != tet.size())
+                {
+                    tetRotationQ.assign(tet.size(), glm::vec4(0, 0, 0, 1));
+                    tetRotation.assign(tet.size(), glm::mat3(1.0f));
+                }
+                dispatchMaterial([&](auto model) { addCubatureForce<decltype(model)>(lame); });
+            }
+
+            float const h = dt;
+            float const alpha = friction / particle_weight;
+            float const stiffnessScale = young / modal.basis.Young;
+            for(int j=0; j<k; j++)
+            {
+                float const lambda = stiffnessScale * modal.basis.Eigenvalues[j];
+                float & q = modal.state(j, 0);
+                float & qd = modal.state(j, 1);
+                qd = (qd + h * (modal.force[j] - lambda * q)) / (1.0f + h * alpha + h * h * lambda);
+                q += h * qd;
+            }
+
+            modal.full.noalias() = Phi * modal.state;
+            x = X + modal.full.col(0);
+            v = modal.full.col(1);
+            std::fill(particleForce.begin(), particleForce.end(), glm::vec3(0.0f));
+        }
+
+        // symplectic Euler is stable for dt < 2 / omega_max; the damping term adds friction / m
+        int stableSubsteps(float const dt) {
+            float const omega = std::sqrt((lameMu() + 1.5f * lameLambda()) * restStiffnessBound / particle_weight);
+            float const dtStable = stabilitySafety * 2.0f / (omega + friction / particle_weight);
+            if(!(dtStable > 0.0f) || dt > dtStable * maxSubsteps) return maxSubsteps;
+            return std::max(1, int(std::ceil(dt / dtStable)));
+        }
+
+        std::array<float, 7> currentSleepParams() const {
+            return { g, young, poison, friction, density, float(material), float(integrator) };
+        }
+
+        void Wake() {
+            modal.stale = true;
+            sleeping = false;
+            settledFrames = 0;
+        }
+
+        // user forces arrive through particleForce before the step
+        bool shouldWake() const {
+            if(currentSleepParams() != sleepParams) return true;
+            for(auto const & f : particleForce)
+                if(f != glm::vec3(0.0f)) return true;
+            return false;
+        }
+
+        void updateSleepState(float const dt) {
+            std::size_t const n = particlePos.size();
+            if(n == 0 || dt <= 0.0f) return;
+            double const speedSq = Common::ParallelSum(0, n, 0.0, [&](std::size_t const i) {
+                return double(glm::dot(particleVel[i], particleVel[i]));
+            });
+            double const changeSq = Common::ParallelSum(0, n, 0.0, [&](std::size_t const i) {
+                glm::vec3 const dv = particleVel[i] - frameStartVel[i];
+                return double(glm::dot(dv, dv));
+            });
+            lastKineticEnergy = float(0.5 * particle_weight * speedSq);
+            lastResidualNorm  = float(particle_weight * std::sqrt(changeSq) / dt);
+
+            float const rmsSpeed = float(std::sqrt(speedSq / n));
+            float const rmsAcceleration = float(std::sqrt(changeSq / n)) / dt;
+            if(allowSleep && rmsSpeed < sleepVelocity * delta && rmsAcceleration < sleepAcceleration * delta)
+                settledFrames++;
+            else
+                settledFrames = 0;
+            if(settledFrames < sleepFrames) return;
+
+            sleeping = true;
+            sleepParams = currentSleepParams();
+            std::fill(particleVel.begin(), particleVel.end(), glm::vec3(0.0f));
+            if(!mf.dvPrev.empty()) std::fill(mf.dvPrev.begin(), mf.dvPrev.end(), glm::vec3(0.0f));
+        }
 
         void SimulateTimestep(float const dt) {
-            int subSteps = 20;
-            for(int i=0; i<subSteps; i++)
+            if(sleeping)
+            {
+                if(!shouldWake()) return;
+                Wake();
+            }
+            frameStartVel = particleVel;
+            // the reduced state only follows the particles while the modal integrator runs
+            if(integrator != Integrator::Modal) modal.stale = true;
+
+            if(integrator == Integrator::Implicit)
             {
-                SimulateSubstep(dt/subSteps);
+                SimulateImplicitStep(dt);
             }
+            else if(integrator == Integrator::ImplicitMatrixFree)
+            {
+                SimulateMatrixFreeStep(dt);
+            }
+            else if(integrator == Integrator::XPBD)
+            {
+                SimulateXPBDStep(dt);
+            }
+            else if(integrator == Integrator::Modal)
+            {
+                SimulateModalStep(dt);
+            }
+            else
+            {
+                int subSteps = adaptiveSubsteps ? stableSubsteps(dt) : explicitSubsteps;
+                lastSubsteps = subSteps;
+                for(int i=0; i<subSteps; i++)
+                {
+                    SimulateSubstep(dt/subSteps);
+                }
+            }
+            updateSleepState(dt);
+        }
+
+        // binds a render mesh given in the rest frame of the tets
+        void EmbedSurfaceMesh(Engine::SurfaceMesh mesh) {
+            embedded.Bind(std::move(mesh), particlePosRest, tet, restDmInv);
+        }
+
+        void UpdateEmbedded() {
+            embedded.Update(particlePos, tet, restDmInv);
         }
 
         inline int GetID(std::size_t const i, std::size_t const j, std::size_t const k)
@@ -124,12 +1326,13 @@ namespace VCX::Labs::FEM {
         }
 
         inline bool is_fixed(const int id) {
-            return id < (wy + 1) * (wz + 1);
+            return particleFixed[id];
         }
 
-        void AddParticle(glm::vec3 const & pos) {
+        void AddParticle(glm::vec3 const & pos, bool const fixed = false) {
             particlePos.push_back(pos);
             particleVel.push_back({0, 0, 0});
+            particleFixed.push_back(fixed);
         }
 
         void AddTet(int const a, int const b, int const c, int const d) {
@@ -137,18 +1340,45 @@ namespace VCX::Labs::FEM {
         }
 
 
+        // drops the geometry and every cache derived from it
+        void clearScene() {
+            particlePos.clear();
+            particleVel.clear();
+            particleFixed.clear();
+            particleForce.clear();
+            tet.clear();
+            implicitMatrix.resize(0, 0);
+            vertexTetOffsets.clear();
+            xpbd.colorTets.clear();
+            tetRotationQ.clear();
+            tetRotation.clear();
+            restStiffness.clear();
+            embedded.Clear();
+            modal.basis = {};
+            modal.cubature = {};
+            modal.cubatureBasis = 0;
+            Wake();
+        }
+
         void setupSceneSimple() {
+            clearScene();
             particlePos = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
             particleVel = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+            particleFixed = {true, false, false, false};
             wx = wy = wz = 0;
+            delta = 1;
             particle_weight = 100;
             AddTet(0,1,2,3);
             // copy Particle Position and Velocity
             particlePosRest = particlePos;
             particleVelRest = particleVel;
+            particleForce.resize(particlePos.size(), {0, 0, 0});
+            precomputeRest();
+            buildSurface();
         }
 
         void setupScene(int _wx, int _wy, int _wz, float _delta) {
+            clearScene();
             wx = _wx;
             wy = _wy;
             wz = _wz;
@@ -157,7 +1387,7 @@ namespace VCX::Labs::FEM {
             for (std::size_t i = 0; i <= wx; i++) {
                 for (std::size_t j = 0; j <= wy; j++) {
                     for (std::size_t k = 0; k <= wz; k++) {
-                        AddParticle({ i * delta, j * delta, k * delta});
+                        AddParticle({ i * delta, j * delta, k * delta}, i == 0);
                     }
                 }
             }
@@ -178,6 +1408,37 @@ namespace VCX::Labs::FEM {
             particlePosRest = particlePos;
             particleVelRest = particleVel;
             particleForce.resize(particlePos.size(), {0, 0, 0});
+            precomputeRest();
+            buildSurface();
+        }
+
+        // imported mesh, pinned at its minimal-x side like the procedural bar
+        void setupSceneFromMesh(TetMesh const & mesh) {
+            clearScene();
+            wx = wy = wz = 0;
+            float minX = std::numeric_limits<float>::max();
+            float maxX = -std::numeric_limits<float>::max();
+            for(auto const & p : mesh.Positions)
+            {
+                minX = std::min(minX, p.x);
+                maxX = std::max(maxX, p.x);
+            }
+            float const pinTolerance = 1e-4f * std::max(maxX - minX, 1e-6f);
+            for(auto const & p : mesh.Positions)
+                AddParticle(p, p.x <= minX + pinTolerance);
+            tet = mesh.Tets;
+
+            particlePosRest = particlePos;
+            particleVelRest = particleVel;
+            particleForce.resize(particlePos.size(), {0, 0, 0});
+            precomputeRest();
+            buildSurface();
+
+            // lumped uniformly, the particles share one weight everywhere else in the simulator
+            float totalVolume = 0.0f;
+            for(float const v : restVolume) totalVolume += v;
+            particle_weight = density * totalVolume / std::max<std::size_t>(particlePos.size(), 1);
+            delta = std::cbrt(totalVolume / std::max<std::size_t>(tet.size(), 1) * 6.0f);
         }
     };
 } // namespace VCX::Labs::Fluid
\ No newline at end of file
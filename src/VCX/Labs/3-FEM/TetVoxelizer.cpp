@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "Labs/3-FEM/TetMesh.h"
+#include "Labs/Common/Parallel.h"
+
+namespace VCX::Labs::FEM {
+    // open addressing with linear probing from packed lattice coordinates to vertex indices
+    class LatticeVertexMap {
+    public:
+        explicit LatticeVertexMap(std::size_t const expected) {
+            std::size_t capacity = 16;
+            while (capacity < 2 * expected) capacity *= 2;
+            _keys.assign(capacity, c_Empty);
+            _values.resize(capacity);
+            _mask = capacity - 1;
+        }
+
+        // index of key, or next if the key is new
+        int FindOrInsert(std::uint64_t const key, int const next) {
+            std::size_t slot = (key * 0x9E3779B97F4A7C15ull >> 20) & _mask;
+            while (true) {
+                if (_keys[slot] == key) return _values[slot];
+                if (_keys[slot] == c_Empty) {
+                    _keys[slot]   = key;
+                    _values[slot] = next;
+                    return next;
+                }
+                slot = (slot + 1) & _mask;
+            }
+        }
+
+    private:
+        static constexpr std::uint64_t c_Empty = ~std::uint64_t(0);
+
+        std::vector<std::uint64_t> _keys;
+        std::vector<int>           _values;
+        std::size_t                _mask = 0;
+    };
+
+    TetMesh VoxelizeSurfaceMesh(Engine::SurfaceMesh const & mesh, int const resolution) {
+        auto const start  = std::chrono::steady_clock::now();
+        int const  nTris  = int(mesh.Indices.size() / 3);
+        if (nTris == 0 || resolution < 1) {
+            spdlog::error("VCX::Labs::FEM::VoxelizeSurfaceMesh: empty mesh or resolution {}.", resolution);
+            return {};
+        }
+        auto const [lo, hi]  = mesh.GetAxisAlignedBoundingBox();
+        glm::vec3 const extent = hi - lo;
+        float const     longest = std::max(extent.x, std::max(extent.y, extent.z));
+        if (! (longest > 0.0f)) {
+            spdlog::error("VCX::Labs::FEM::VoxelizeSurfaceMesh: degenerate bounding box.");
+            return {};
+        }
+        float const      cell   = longest / resolution;
+        glm::ivec3 const dims   = glm::max(glm::ivec3(1), glm::ivec3(glm::ceil(extent / cell)));
+        glm::vec3 const  origin = 0.5f * (lo + hi) - 0.5f * cell * glm::vec3(dims);
+        // the rays run along x through the cell centers, nudged off the lattice so that they miss
+        // the edges and vertices of axis-aligned meshes
+        float const offsetY = 1.37e-3f * cell;
+        float const offsetZ = 2.91e-3f * cell;
+        auto const  rayY    = [&](int const j) { return origin.y + (j + 0.5f) * cell + offsetY; };
+        auto const  rayZ    = [&](int const k) { return origin.z + (k + 0.5f) * cell + offsetZ; };
+        auto const  rowOf   = [&](float const y) { return std::clamp(int(std::floor((y - origin.y - offsetY) / cell - 0.5f)), -1, dims.y - 1); };
+        auto const  layerOf = [&](float const z) { return std::clamp(int(std::floor((z - origin.z - offsetZ) / cell - 0.5f)), -1, dims.z - 1); };
+
+        // triangles listed in every row of rays their y range covers, in CSR form
+        std::vector<int> rowOffsets(dims.y + 1, 0);
+        std::vector<int> rowTris;
+        for (int pass = 0; pass < 2; pass++) {
+            std::vector<int> cursor;
+            if (pass == 1) {
+                for (int j = 0; j < dims.y; j++) rowOffsets[j + 1] += rowOffsets[j];
+                rowTris.resize(rowOffsets.back());
+                cursor.assign(rowOffsets.begin(), rowOffsets.end() - 1);
+            }
+            for (int t = 0; t < nTris; t++) {
+                float yMin = mesh.Positions[mesh.Indices[3 * t]].y, yMax = yMin;
+                for (int a = 1; a < 3; a++) {
+                    yMin = std::min(yMin, mesh.Positions[mesh.Indices[3 * t + a]].y);
+                    yMax = std::max(yMax, mesh.Positions[mesh.Indices[3 * t + a]].y);
+                }
+                for (int j = rowOf(yMin) + 1; j <= rowOf(yMax); j++) {
+                    if (pass == 0) rowOffsets[j + 1]++;
+                    else rowTris[cursor[j]++] = t;
+                }
+            }
+        }
+
+        // each row of rays is independent and owns its cells, so no synchronization is needed
+        std::vector<std::uint8_t> solid(std::size_t(dims.x) * dims.y * dims.z, 0);
+        auto const cellIndex = [&](int const i, int const j, int const k) { return (std::size_t(i) * dims.y + j) * dims.z + k; };
+        Common::ParallelFor(0, std::size_t(dims.y), [&](std::size_t const row) {
+            int const                       j = int(row);
+            float const                     y = rayY(j);
+            std::vector<std::vector<float>> hits(dims.z);
+            for (int e = rowOffsets[j]; e < rowOffsets[j + 1]; e++) {
+                int const         t = rowTris[e];
+                glm::vec3 const & a = mesh.Positions[mesh.Indices[3 * t]];
+                glm::vec3 const & b = mesh.Positions[mesh.Indices[3 * t + 1]];
+                glm::vec3 const & c = mesh.Positions[mesh.Indices[3 * t + 2]];
+                // twice the signed area of the triangle projected to the yz plane
+                float const area = (b.y - a.y) * (c.z - a.z) - (c.y - a.y) * (b.z - a.z);
+                if (area == 0.0f) continue;
+                int const k0 = layerOf(std::min(a.z, std::min(b.z, c.z))) + 1;
+                int const k1 = layerOf(std::max(a.z, std::max(b.z, c.z)));
+                for (int k = k0; k <= k1; k++) {
+                    float const z  = rayZ(k);
+                    float const wa = ((b.y - y) * (c.z - z) - (c.y - y) * (b.z - z)) / area;
+                    float const wb = ((c.y - y) * (a.z - z) - (a.y - y) * (c.z - z)) / area;
+                    float const wc = 1.0f - wa - wb;
+                    if (wa < 0.0f || wb < 0.0f || wc < 0.0f) continue;
+                    hits[k].push_back(wa * a.x + wb * b.x + wc * c.x);
+                }
+            }
+            for (int k = 0; k < dims.z; k++) {
+                auto & xs = hits[k];
+                if (xs.size() < 2) continue;
+                std::sort(xs.begin(), xs.end());
+                std::size_t crossed = 0;
+                for (int i = 0; i < dims.x; i++) {
+                    float const x = origin.x + (i + 0.5f) * cell;
+                    while (crossed < xs.size() && xs[crossed] < x) crossed++;
+                    if (crossed == xs.size()) break;
+                    solid[cellIndex(i, j, k)] = crossed & 1;
+                }
+            }
+        }, 1);
+
+        std::size_t nSolid = 0;
+        for (auto const s : solid) nSolid += s;
+
+        // corners numbered in the order the cubes are visited, i major as in setupScene
+        TetMesh          result;
+        LatticeVertexMap vertices(std::min(8 * nSolid, std::size_t(dims.x + 1) * (dims.y + 1) * (dims.z + 1)));
+        result.Tets.reserve(6 * nSolid);
+        auto const corner = [&](int const i, int const j, int const k) {
+            std::uint64_t const key = (std::uint64_t(i) * (dims.y + 1) + j) * (dims.z + 1) + k;
+            int const           id  = vertices.FindOrInsert(key, int(result.Positions.size()));
+            if (id == int(result.Positions.size())) result.Positions.push_back(origin + cell * glm::vec3(i, j, k));
+            return id;
+        };
+        for (int i = 0; i < dims.x; i++) {
+            for (int j = 0; j < dims.y; j++) {
+                for (int k = 0; k < dims.z; k++) {
+                    if (! solid[cellIndex(i, j, k)]) continue;
+                    int c[2][2][2];
+                    for (int di = 0; di < 2; di++)
+                        for (int dj = 0; dj < 2; dj++)
+                            for (int dk = 0; dk < 2; dk++) c[di][dj][dk] = corner(i + di, j + dj, k + dk);
+                    result.Tets.push_back({ c[0][0][0], c[0][0][1], c[0][1][1], c[1][1][1] });
+                    result.Tets.push_back({ c[0][0][0], c[0][1][0], c[0][1][1], c[1][1][1] });
+                    result.Tets.push_back({ c[0][0][0], c[0][0][1], c[1][0][1], c[1][1][1] });
+                    result.Tets.push_back({ c[0][0][0], c[1][0][0], c[1][0][1], c[1][1][1] });
+                    result.Tets.push_back({ c[0][0][0], c[0][1][0], c[1][1][0], c[1][1][1] });
+                    result.Tets.push_back({ c[0][0][0], c[1][0][0], c[1][1][0], c[1][1][1] });
+                }
+            }
+        }
+
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (result.Tets.empty())
+            spdlog::warn("VCX::Labs::FEM::VoxelizeSurfaceMesh: no cube center is inside, the mesh may not be closed.");
+        spdlog::info(
+            "VCX::Labs::FEM::VoxelizeSurfaceMesh: {} triangles, {}x{}x{} grid, {} cubes, {} vertices, {} tets in {:.3f} s.",
+            nTris, dims.x, dims.y, dims.z, nSolid, result.Positions.size(), result.Tets.size(), seconds);
+        return result;
+    }
+} // namespace VCX::Labs::FEM
@@ -1,8 +1,28 @@
 #include "Engine/app.h"
 #include "Labs/4-PD/CaseMassSpring.h"
 #include "Labs/Common/ImGuiHelper.h"
+#include <algorithm>
+#include <array>
 
 namespace VCX::Labs::PD {
+    static constexpr auto c_Accelerations = std::array<char const *, 3> {
+        "None",
+        "Chebyshev",
+        "Anderson",
+    };
+
+    static constexpr auto c_GlobalSolves = std::array<char const *, 2> {
+        "Cholesky",
+        "Chebyshev-Jacobi",
+    };
+
+    static constexpr auto c_ClothPins = std::array<char const *, 4> {
+        "Two Corners",
+        "Four Corners",
+        "First Row",
+        "None",
+    };
+
     CaseMassSpring::CaseMassSpring():
         _program(
             Engine::GL::UniqueProgram({ Engine::GL::SharedShader("assets/shaders/flat.vert"),
@@ -24,6 +44,62 @@ namespace VCX::Labs::PD {
             ImGui::SliderFloat("Spr. Stiff.", &_massSpringSystem.Stiffness, 10.f, 300.f);
             ImGui::SliderFloat("Spr. Damp.", &_massSpringSystem.Damping, 0.0f, 5.f);
             ImGui::SliderFloat("Gravity", &_massSpringSystem.Gravity, .1f, 1.f);
+            // constraints with zero stiffness are skipped entirely
+            ImGui::SliderFloat("Bend. Stiff.", &_massSpringSystem.BendingStiffness, 0.f, 100.f);
+            ImGui::SliderFloat("Strain Stiff.", &_massSpringSystem.StrainStiffness, 0.f, 1000.f);
+            ImGui::SliderFloat2("Strain Limits", _massSpringSystem.StrainLimits.data(), .5f, 1.5f);
+            ImGui::Checkbox("Self Collision", &_massSpringSystem.EnableSelfCollision);
+            if (_massSpringSystem.EnableSelfCollision) {
+                // thicker than an edge, the neighbours of a vertex would push it out of flat cloth
+                auto &      collision    = _massSpringSystem.CollisionData;
+                float const maxThickness = std::min(.05f, collision.MeanEdgeLength());
+                collision.Thickness      = std::min(collision.Thickness, maxThickness);
+                ImGui::SliderFloat("Thickness", &collision.Thickness, .001f, maxThickness, "%.3f");
+                ImGui::Text("Contacts: %d", _massSpringSystem.CollisionData.LastContacts);
+            }
+            // fixed, so the factorized system matrix survives from frame to frame
+            ImGui::SliderFloat("Time Step", &_timeStep, 1.f / 240, 1.f / 30, "%.4f");
+        }
+        ImGui::Spacing();
+
+        if (ImGui::CollapsingHeader("Cloth")) {
+            // takes effect on reset; only the smallest preset is offered here, the larger ones are
+            // too slow to step interactively and are run headless by lab4 --benchmark
+            auto const & preset     = c_ClothPresets.front();
+            int          resolution = int(_cloth.Resolution);
+            if (ImGui::SliderInt("Resolution", &resolution, 2, int(preset.Resolution))) _cloth.Resolution = std::size_t(resolution);
+            if (ImGui::Button(preset.Name.data())) {
+                _cloth.Resolution = preset.Resolution;
+                ResetSystem();
+            }
+            int pinsId = int(_cloth.Pins);
+            if (ImGui::Combo("Pins", &pinsId, c_ClothPins.data(), c_ClothPins.size())) _cloth.Pins = ClothPins(pinsId);
+            ImGui::Text("%zu particles, factored in %.3f s", _massSpringSystem.Positions.size(), _massSpringSystem.LastFactorSeconds);
+            ImGui::Text("Local %.2f ms, global %.2f ms per step", _massSpringSystem.LastLocalSeconds * 1e3, _massSpringSystem.LastGlobalSeconds * 1e3);
+        }
+        ImGui::Spacing();
+
+        if (ImGui::CollapsingHeader("Solver", ImGuiTreeNodeFlags_DefaultOpen)) {
+            int globalId = int(_massSpringSystem.Global);
+            if (ImGui::Combo("Global Step", &globalId, c_GlobalSolves.data(), c_GlobalSolves.size()))
+                _massSpringSystem.Global = MassSpringSystem::GlobalSolve(globalId);
+            if (_massSpringSystem.Global == MassSpringSystem::GlobalSolve::Jacobi)
+                ImGui::SliderInt("Sweeps", &_massSpringSystem.JacobiIterations, 1, 50);
+            int accelId = int(_massSpringSystem.Accel);
+            if (ImGui::Combo("Acceleration", &accelId, c_Accelerations.data(), c_Accelerations.size()))
+                _massSpringSystem.Accel = MassSpringSystem::Acceleration(accelId);
+            ImGui::SliderInt("Max Iters", &_massSpringSystem.MaxIterations, 1, 100);
+            ImGui::SliderFloat("Tolerance", &_massSpringSystem.Tolerance, 1e-7f, 1e-3f, "%.1e", ImGuiSliderFlags_Logarithmic);
+            if (_massSpringSystem.Accel == MassSpringSystem::Acceleration::Chebyshev) {
+                ImGui::Checkbox("Auto Radius", &_massSpringSystem.AutoSpectralRadius);
+                ImGui::SameLine();
+                ImGui::SliderFloat("Radius", &_massSpringSystem.SpectralRadius, 0.f, .999f);
+            }
+            if (_massSpringSystem.Accel == MassSpringSystem::Acceleration::Anderson) {
+                ImGui::SliderInt("Window", &_massSpringSystem.AndersonWindow, 1, 20);
+                ImGui::Text("Safeguard resets: %d", _massSpringSystem.LastAndersonResets);
+            }
+            ImGui::Text("Iterations: %d, update %.2e", _massSpringSystem.LastIterations, _massSpringSystem.LastUpdateNorm);
         }
         ImGui::Spacing();
 
@@ -38,6 +114,8 @@ namespace VCX::Labs::PD {
         if (ImGui::CollapsingHeader("Control")) {
             ImGui::SliderFloat("Force. Scale", &_forceScale, 50, 200);
             ImGui::SliderFloat("Force. Range", &_forceRange, 0.1, 5.0);
+            // the grabbed particle is pinned and dragged, the factor is corrected instead of rebuilt
+            ImGui::Checkbox("Grab Particle", &_grabParticle);
         }
         ImGui::Spacing();    
     }
@@ -50,6 +128,20 @@ namespace VCX::Labs::PD {
         // std::cout << "forceVec: " << forceVec.x << " " << forceVec.y << " " << forceVec.z << std::endl;
         // std::cout << "pointId: " << pointId << std::endl;
 
+        if (_grabParticle || _grabbedId >= 0) {
+            if (_forceManager.IsHolding() && _grabParticle) {
+                if (_grabbedId < 0 && forceVec != glm::vec3(0) && ! _massSpringSystem.Fixed[pointId]) {
+                    _grabbedId                          = pointId;
+                    _massSpringSystem.Fixed[_grabbedId] = true;
+                }
+                if (_grabbedId >= 0) _massSpringSystem.Positions[_grabbedId] += forceVec;
+            } else if (_grabbedId >= 0) {
+                _massSpringSystem.Fixed[_grabbedId] = false;
+                _grabbedId                          = -1;
+            }
+            return;
+        }
+
         glm::vec3 pointPos = _massSpringSystem.Positions[pointId];
         
         // apply force to the point around the mouse
@@ -75,7 +167,7 @@ namespace VCX::Labs::PD {
         OnProcessMouseControl(force);
 
         if (! _stopped) {
-            _massSpringSystem.AdvanceMassSpringSystem(Engine::GetDeltaTime());
+            _massSpringSystem.AdvanceMassSpringSystem(_timeStep);
         }
 
         _particlesItem.UpdateVertexBuffer("position", Engine::make_span_bytes<glm::vec3>(_massSpringSystem.Positions));
@@ -122,33 +214,43 @@ namespace VCX::Labs::PD {
         float const stiffness = _massSpringSystem.Stiffness;
         float const damping = _massSpringSystem.Damping;
         float const gravity = _massSpringSystem.Gravity;
+        auto const  accel = _massSpringSystem.Accel;
+        int const   maxIterations = _massSpringSystem.MaxIterations;
+        float const tolerance = _massSpringSystem.Tolerance;
+        bool const  autoRadius = _massSpringSystem.AutoSpectralRadius;
+        float const radius = _massSpringSystem.SpectralRadius;
+        int const   window = _massSpringSystem.AndersonWindow;
+        auto const  global = _massSpringSystem.Global;
+        int const   sweeps = _massSpringSystem.JacobiIterations;
+        float const bending = _massSpringSystem.BendingStiffness;
+        float const strain = _massSpringSystem.StrainStiffness;
+        auto const  strainLimits = _massSpringSystem.StrainLimits;
+        bool const  selfCollision = _massSpringSystem.EnableSelfCollision;
+        float const thickness = _massSpringSystem.CollisionData.Thickness;
 
         _massSpringSystem       = {};
+        _grabbedId              = -1;
         // recover the mass, stiffness, damping and gravity
         _massSpringSystem.Mass = mass;
         _massSpringSystem.Stiffness = stiffness;
         _massSpringSystem.Damping = damping;
         _massSpringSystem.Gravity = gravity;
+        _massSpringSystem.Accel = accel;
+        _massSpringSystem.MaxIterations = maxIterations;
+        _massSpringSystem.Tolerance = tolerance;
+        _massSpringSystem.AutoSpectralRadius = autoRadius;
+        _massSpringSystem.SpectralRadius = radius;
+        _massSpringSystem.AndersonWindow = window;
+        _massSpringSystem.Global = global;
+        _massSpringSystem.JacobiIterations = sweeps;
+        _massSpringSystem.BendingStiffness = bending;
+        _massSpringSystem.StrainStiffness = strain;
+        _massSpringSystem.StrainLimits = strainLimits;
+        _massSpringSystem.EnableSelfCollision = selfCollision;
+        _massSpringSystem.CollisionData.Thickness = thickness;
 
 
-        std::size_t const n     = 10;
-        float const       delta = 2.f / n;
-        auto constexpr GetID    = [](std::size_t const i, std::size_t const j) { return i * (n + 1) + j; };
-        for (std::size_t i = 0; i <= n; i++) {
-            for (std::size_t j = 0; j <= n; j++) {
-                _massSpringSystem.AddParticle(glm::vec3(i * delta, 1.5f, j * delta - 1.f));
-                if (i > 0) _massSpringSystem.AddSpring(GetID(i, j), GetID(i - 1, j));
-                if (i > 1) _massSpringSystem.AddSpring(GetID(i, j), GetID(i - 2, j));
-                if (j > 0) _massSpringSystem.AddSpring(GetID(i, j), GetID(i, j - 1));
-                if (j > 1) _massSpringSystem.AddSpring(GetID(i, j), GetID(i, j - 2));
-                if (i > 0 && j > 0) _massSpringSystem.AddSpring(GetID(i, j), GetID(i - 1, j - 1));
-                if (i > 0 && j < n) _massSpringSystem.AddSpring(GetID(i, j), GetID(i - 1, j + 1));
-            }
-        }
-        _massSpringSystem.Fixed[GetID(0, 0)] = true;
-        _massSpringSystem.Fixed[GetID(0, n)] = true;
-        // _massSpringSystem.Fixed[GetID(n, 0)] = true;
-        // _massSpringSystem.Fixed[GetID(n, n)] = true;
+        BuildCloth(_massSpringSystem, _cloth);
         std::vector<std::uint32_t> indices;
         for (auto const & spring : _massSpringSystem.Springs) {
             indices.push_back(std::uint32_t(spring.AdjIdx.first));
@@ -3,6 +3,7 @@
 #include "Engine/GL/Frame.hpp"
 #include "Engine/GL/Program.h"
 #include "Engine/GL/RenderItem.h"
+#include "Labs/4-PD/ClothScene.h"
 #include "Labs/4-PD/MassSpringSystem.h"
 #include "Labs/Common/ICase.h"
 #include "Labs/Common/ImageRGB.h"
@@ -34,11 +35,15 @@ namespace VCX::Labs::PD {
         glm::vec3                           _particleColor { 1.f, 0.f, 0.f };
         glm::vec3                           _springColor { 0.f, 0.f, 1.f };
         bool                                _stopped { false };
+        float                               _timeStep { 1.f / 60 };
         Common::ForceManager                _forceManager;
         float                               _forceScale {50.0f};
         float                               _forceRange  {2.0f};
+        bool                                _grabParticle { false };
+        int                                 _grabbedId { -1 };
 
         MassSpringSystem _massSpringSystem;
+        ClothOptions     _cloth;
 
         void ResetSystem();
     };
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+#include "Labs/4-PD/ClothScene.h"
+
+namespace VCX::Labs::PD {
+    void BuildCloth(MassSpringSystem & system, ClothOptions const & options) {
+        std::size_t const n     = std::max<std::size_t>(options.Resolution, 2) - 1; // quads per side
+        float const       delta = options.Size / n;
+        auto const        GetID = [n](std::size_t const i, std::size_t const j) { return i * (n + 1) + j; };
+        for (std::size_t i = 0; i <= n; i++) {
+            for (std::size_t j = 0; j <= n; j++) {
+                system.AddParticle(glm::vec3(i * delta, 1.5f, j * delta - .5f * options.Size));
+                if (i > 0) system.AddSpring(GetID(i, j), GetID(i - 1, j));
+                if (i > 1) system.AddSpring(GetID(i, j), GetID(i - 2, j));
+                if (j > 0) system.AddSpring(GetID(i, j), GetID(i, j - 1));
+                if (j > 1) system.AddSpring(GetID(i, j), GetID(i, j - 2));
+                if (i > 0 && j > 0) system.AddSpring(GetID(i, j), GetID(i - 1, j - 1));
+                if (options.Bending) {
+                    if (i > 1) system.AddBending(GetID(i - 2, j), GetID(i - 1, j), GetID(i, j));
+                    if (j > 1) system.AddBending(GetID(i, j - 2), GetID(i, j - 1), GetID(i, j));
+                }
+                if (options.Triangles && i > 0 && j > 0) {
+                    system.AddTriangle(GetID(i - 1, j - 1), GetID(i, j - 1), GetID(i, j));
+                    system.AddTriangle(GetID(i - 1, j - 1), GetID(i, j), GetID(i - 1, j));
+                }
+                if (i > 0 && j < n) system.AddSpring(GetID(i, j), GetID(i - 1, j + 1));
+            }
+        }
+        switch (options.Pins) {
+        case ClothPins::TwoCorners:
+            system.Fixed[GetID(0, 0)] = true;
+            system.Fixed[GetID(0, n)] = true;
+            break;
+        case ClothPins::FourCorners:
+            for (std::size_t const id : { GetID(0, 0), GetID(0, n), GetID(n, 0), GetID(n, n) }) system.Fixed[id] = true;
+            break;
+        case ClothPins::FirstRow:
+            for (std::size_t j = 0; j <= n; j++) system.Fixed[GetID(0, j)] = true;
+            break;
+        case ClothPins::None:
+            break;
+        }
+    }
+
+    ClothBenchmarkReport RunClothBenchmark(MassSpringSystem & system, ClothOptions const & options, int const steps, float const dt) {
+        ClothBenchmarkReport report;
+        auto const           start = std::chrono::steady_clock::now();
+        BuildCloth(system, options);
+        system.sync_batch_parameters();
+        system.build_batches();
+        report.SetupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        system.prefactorize_lhs(dt);
+        report.FactorSeconds = system.LastFactorSeconds;
+
+        int    iterations = 0;
+        double contacts   = 0;
+        for (int k = 0; k < steps; k++) {
+            auto const stepStart = std::chrono::steady_clock::now();
+            system.AdvanceMassSpringSystem(dt);
+            report.StepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count();
+            iterations += system.LastIterations;
+            contacts += system.CollisionData.LastContacts;
+            report.LocalSeconds += system.LastLocalSeconds;
+            report.GlobalSeconds += system.LastGlobalSeconds;
+        }
+        if (iterations > 0) {
+            report.LocalSeconds /= iterations;
+            report.GlobalSeconds /= iterations;
+        }
+        if (steps > 0) {
+            report.StepSeconds /= steps;
+            report.Contacts = contacts / steps;
+        }
+        report.Iterations  = steps > 0 ? double(iterations) / steps : 0;
+        report.Particles   = system.Positions.size();
+        report.Springs     = system.Springs.size();
+        report.MemoryBytes = system.MemoryBytes();
+        return report;
+    }
+
+    int RunClothBenchmarks(std::vector<std::string_view> const & presets) {
+        for (std::string_view const name : presets) {
+            if (std::none_of(c_ClothPresets.begin(), c_ClothPresets.end(), [&](ClothPreset const & preset) { return preset.Name == name; })) {
+                spdlog::error("VCX::Labs::PD::RunClothBenchmarks: unknown preset \"{}\", expected 64, 256, 1024 or 100.", name);
+                return 1;
+            }
+        }
+        for (ClothPreset const & preset : c_ClothPresets) {
+            if (! presets.empty() && std::find(presets.begin(), presets.end(), preset.Name) == presets.end()) continue;
+            MassSpringSystem system;
+            system.EnableSelfCollision        = preset.SelfCollision;
+            ClothBenchmarkReport const report = RunClothBenchmark(system, { .Resolution = preset.Resolution }, 10, 1.f / 60);
+            spdlog::info(
+                "VCX::Labs::PD::RunClothBenchmarks: {}^2, {} particles, {} springs: setup {:.3f} s, factorization {:.3f} s, "
+                "{:.1f} iterations per step, local {:.3f} ms and global {:.3f} ms per iteration, {:.1f} MiB.",
+                preset.Name, report.Particles, report.Springs, report.SetupSeconds, report.FactorSeconds,
+                report.Iterations, report.LocalSeconds * 1e3, report.GlobalSeconds * 1e3, report.MemoryBytes / 1048576.0);
+            if (preset.SelfCollision) {
+                spdlog::info(
+                    "VCX::Labs::PD::RunClothBenchmarks: {}^2 with self-collision: {:.2f} ms per step with {:.0f} contacts on {} threads, {} the 16.7 ms of a 60 Hz frame.",
+                    preset.Name, report.StepSeconds * 1e3, report.Contacts, Common::ThreadPool::Instance().Concurrency(),
+                    report.StepSeconds <= 1. / 60 ? "within" : "over");
+            }
+        }
+        return 0;
+    }
+} // namespace VCX::Labs::PD
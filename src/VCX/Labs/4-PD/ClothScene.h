@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "Labs/4-PD/MassSpringSystem.h"
+
+namespace VCX::Labs::PD {
+    enum class ClothPins {
+        TwoCorners,  // the two corners of the first row
+        FourCorners,
+        FirstRow,    // the whole first row, a curtain
+        None,
+    };
+
+    // A square sheet of Resolution x Resolution particles, horizontal at height 1.5. Springs join
+    // the grid neighbours, one diagonal of every quad and the particles two apart; the bending lines
+    // and the triangles (strain limiting and self-collision) are optional.
+    struct ClothOptions {
+        std::size_t Resolution { 11 };
+        float       Size { 2 };
+        ClothPins   Pins { ClothPins::TwoCorners };
+        bool        Bending { true };
+        bool        Triangles { true };
+    };
+
+    // Appends the sheet to an empty system.
+    void BuildCloth(MassSpringSystem & system, ClothOptions const & options);
+
+    struct ClothPreset {
+        std::string_view Name;
+        std::size_t      Resolution;
+        bool             SelfCollision { false };
+    };
+
+    // the last one checks the self-collision pass against a frame budget of 1 / 60 s
+    inline constexpr std::array<ClothPreset, 4> c_ClothPresets { {
+        { "64", 64 },
+        { "256", 256 },
+        { "1024", 1024 },
+        { "100", 100, true },
+    } };
+
+    struct ClothBenchmarkReport {
+        std::size_t Particles { 0 };
+        std::size_t Springs { 0 };
+        double      SetupSeconds { 0 };     // building the sheet and its constraint batches
+        double      FactorSeconds { 0 };    // the global matrix and its factorization
+        double      LocalSeconds { 0 };     // per local-global iteration
+        double      GlobalSeconds { 0 };
+        double      Iterations { 0 };       // per step
+        double      StepSeconds { 0 };      // a whole step, self-collision included
+        double      Contacts { 0 };         // found by the self-collision pass, per step
+        std::size_t MemoryBytes { 0 };
+    };
+
+    // Builds the sheet into the empty system and steps it without a window, with the solver
+    // settings the system was given.
+    ClothBenchmarkReport RunClothBenchmark(MassSpringSystem & system, ClothOptions const & options, int const steps, float const dt);
+
+    // Runs the presets named in presets, all of them if none is, and logs one line per preset.
+    // Returns the exit code of the program.
+    int RunClothBenchmarks(std::vector<std::string_view> const & presets);
+} // namespace VCX::Labs::PD
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include <glm/glm.hpp>
+
+#include "Labs/Common/Parallel.h"
+
+namespace VCX::Labs::PD {
+    // Constraint batches of projective dynamics. A constraint over N particles has the energy
+    // k w / 2 |A x - p|^2, where A is a constant linear map of its positions, p the projection of
+    // A x onto the constraint set, k the stiffness of the batch and w a per-constraint weight such
+    // as the rest area. Every constraint type keeps all of its constraints in one batch whose data
+    // is laid out slot-major: entry a * Size() + c belongs to particle a of constraint c, so the
+    // projection kernel of a type streams over contiguous arrays. A kernel writes the force
+    // k w A^T (p - A x) on every slot; the particles gather their slots through a CSR list, so no
+    // two threads write the same memory. A type only adds its own batch, kernel and A^T A to the
+    // system, the loops of the other types are untouched.
+    template<int N>
+    struct ConstraintBatch {
+        static constexpr int Arity = N;
+
+        float                           Stiffness { 0 };
+        std::vector<std::array<int, N>> Elements;
+        std::vector<float>              Weight;
+
+        std::vector<int>   Slots;           // particle of each slot
+        std::vector<float> PX, PY, PZ;      // slot positions, loaded before the projection
+        std::vector<float> FX, FY, FZ;      // slot forces, also the scratch of the kernels
+        std::vector<float> Energy;          // per constraint
+        std::vector<int>   ParticleOffsets; // CSR over particles
+        std::vector<int>   ParticleSlots;
+
+        std::size_t Size() const { return Elements.size(); }
+        bool        Active() const { return Stiffness > 0 && ! Elements.empty(); }
+
+        // lays out the slots and the gather lists, after the last constraint was added
+        void Prepare(std::size_t const particles) {
+            std::size_t const m = Size();
+            Slots.resize(N * m);
+            for (auto * v : { &PX, &PY, &PZ, &FX, &FY, &FZ }) v->resize(N * m);
+            Energy.resize(m);
+            for (std::size_t c = 0; c < m; c++)
+                for (int a = 0; a < N; a++) Slots[a * m + c] = Elements[c][a];
+
+            ParticleOffsets.assign(particles + 1, 0);
+            for (int const p : Slots) ParticleOffsets[p + 1]++;
+            for (std::size_t i = 0; i < particles; i++) ParticleOffsets[i + 1] += ParticleOffsets[i];
+            ParticleSlots.resize(Slots.size());
+            std::vector<int> cursor(ParticleOffsets.begin(), ParticleOffsets.end() - 1);
+            for (std::size_t s = 0; s < Slots.size(); s++) ParticleSlots[cursor[Slots[s]]++] = int(s);
+        }
+
+        void Load(std::vector<glm::vec3> const & positions, std::size_t const b, std::size_t const e) {
+            std::size_t const m = Size();
+            for (int a = 0; a < N; a++) {
+                for (std::size_t s = a * m + b; s < a * m + e; s++) {
+                    glm::vec3 const & x = positions[Slots[s]];
+                    PX[s]               = x.x;
+                    PY[s]               = x.y;
+                    PZ[s]               = x.z;
+                }
+            }
+        }
+
+        // the values of slot a for the constraints [b, e)
+        Eigen::Map<Eigen::ArrayXf> Slot(std::vector<float> & v, int const a, std::size_t const b, std::size_t const e) {
+            return Eigen::Map<Eigen::ArrayXf>(v.data() + a * Size() + b, Eigen::Index(e - b));
+        }
+
+        Eigen::Map<Eigen::ArrayXf> Block(std::vector<float> & v, std::size_t const b, std::size_t const e) {
+            return Eigen::Map<Eigen::ArrayXf>(v.data() + b, Eigen::Index(e - b));
+        }
+
+        void Gather(std::size_t const i, glm::vec3 & f) const {
+            for (int k = ParticleOffsets[i]; k < ParticleOffsets[i + 1]; k++) {
+                int const s = ParticleSlots[k];
+                f += glm::vec3(FX[s], FY[s], FZ[s]);
+            }
+        }
+
+        double TotalEnergy() const {
+            return Common::ParallelSum(0, Energy.size(), 0.0, [&](std::size_t const c) { return double(Energy[c]); });
+        }
+
+        std::size_t MemoryBytes() const {
+            std::size_t bytes = Elements.capacity() * sizeof(Elements[0]) + Weight.capacity() * sizeof(float) + Slots.capacity() * sizeof(int);
+            for (auto const * v : { &PX, &PY, &PZ, &FX, &FY, &FZ, &Energy }) bytes += v->capacity() * sizeof(float);
+            return bytes + (ParticleOffsets.capacity() + ParticleSlots.capacity()) * sizeof(int);
+        }
+    };
+
+    // Keeps |x1 - x0| at the rest length, A x = x1 - x0.
+    struct SpringBatch : ConstraintBatch<2> {
+        std::vector<float> RestLength;
+
+        void Add(int const i, int const j, float const restLength) {
+            Elements.push_back({ i, j });
+            Weight.push_back(1);
+            RestLength.push_back(restLength);
+        }
+
+        std::size_t MemoryBytes() const { return ConstraintBatch<2>::MemoryBytes() + RestLength.capacity() * sizeof(float); }
+
+        void Project(std::size_t const b, std::size_t const e) {
+            auto dx = Slot(FX, 1, b, e), dy = Slot(FY, 1, b, e), dz = Slot(FZ, 1, b, e);
+            auto fx = Slot(FX, 0, b, e), fy = Slot(FY, 0, b, e), fz = Slot(FZ, 0, b, e);
+            auto length = Block(Energy, b, e);
+            auto rest   = Block(RestLength, b, e);
+            dx          = Slot(PX, 1, b, e) - Slot(PX, 0, b, e);
+            dy          = Slot(PY, 1, b, e) - Slot(PY, 0, b, e);
+            dz          = Slot(PZ, 1, b, e) - Slot(PZ, 0, b, e);
+            length      = (dx.square() + dy.square() + dz.square()).sqrt().max(1e-12f);
+            fx          = Stiffness * Block(Weight, b, e) * (rest / length - 1); // scale of the force on particle 1
+            length      = .5f * Stiffness * Block(Weight, b, e) * (length - rest).square();
+            dx *= fx;
+            dy *= fx;
+            dz *= fx;
+            fx = -dx;
+            fy = -dy;
+            fz = -dz;
+        }
+
+        template<typename Emit>
+        void Hessian(Emit && emit) const {
+            for (std::size_t c = 0; c < Size(); c++) {
+                float const w = Stiffness * Weight[c];
+                auto const & el = Elements[c];
+                emit(el[0], el[0], w);
+                emit(el[1], el[1], w);
+                emit(el[0], el[1], -w);
+                emit(el[1], el[0], -w);
+            }
+        }
+    };
+
+    // Keeps the length of the second difference x0 - 2 x1 + x2 along a line of particles at its rest
+    // value, a discrete curvature term that leaves the stretch to the springs.
+    struct BendingBatch : ConstraintBatch<3> {
+        static constexpr std::array<float, 3> c_Stencil { 1, -2, 1 };
+
+        std::vector<float> RestCurvature;
+
+        void Add(int const i, int const j, int const k, float const restCurvature) {
+            Elements.push_back({ i, j, k });
+            Weight.push_back(1);
+            RestCurvature.push_back(restCurvature);
+        }
+
+        std::size_t MemoryBytes() const { return ConstraintBatch<3>::MemoryBytes() + RestCurvature.capacity() * sizeof(float); }
+
+        void Project(std::size_t const b, std::size_t const e) {
+            auto vx = Slot(FX, 0, b, e), vy = Slot(FY, 0, b, e), vz = Slot(FZ, 0, b, e);
+            auto scale  = Slot(FX, 1, b, e);
+            auto length = Block(Energy, b, e);
+            auto rest   = Block(RestCurvature, b, e);
+            vx          = Slot(PX, 0, b, e) - 2 * Slot(PX, 1, b, e) + Slot(PX, 2, b, e);
+            vy          = Slot(PY, 0, b, e) - 2 * Slot(PY, 1, b, e) + Slot(PY, 2, b, e);
+            vz          = Slot(PZ, 0, b, e) - 2 * Slot(PZ, 1, b, e) + Slot(PZ, 2, b, e);
+            length      = (vx.square() + vy.square() + vz.square()).sqrt().max(1e-12f);
+            scale       = Stiffness * Block(Weight, b, e) * (rest / length - 1);
+            length      = .5f * Stiffness * Block(Weight, b, e) * (length - rest).square();
+            vx *= scale;
+            vy *= scale;
+            vz *= scale;
+            Slot(FX, 2, b, e) = vx;
+            Slot(FY, 2, b, e) = vy;
+            Slot(FZ, 2, b, e) = vz;
+            Slot(FX, 1, b, e) = -2 * vx;
+            Slot(FY, 1, b, e) = -2 * vy;
+            Slot(FZ, 1, b, e) = -2 * vz;
+        }
+
+        template<typename Emit>
+        void Hessian(Emit && emit) const {
+            for (std::size_t c = 0; c < Size(); c++) {
+                float const w = Stiffness * Weight[c];
+                for (int a = 0; a < 3; a++)
+                    for (int d = 0; d < 3; d++) emit(Elements[c][a], Elements[c][d], w * c_Stencil[a] * c_Stencil[d]);
+            }
+        }
+    };
+
+    // Strain limiting of a triangle: the singular values of its 3 x 2 deformation gradient
+    // F = sum_a x_a g_a^T are clamped to [MinStretch, MaxStretch]. F^T F is 2 x 2, so the
+    // projection is closed form and the kernel is a branch-free loop over the SoA slots.
+    struct TriangleStrainBatch : ConstraintBatch<3> {
+        float              MinStretch { .95f };
+        float              MaxStretch { 1.05f };
+        std::vector<float> GX, GY; // slot-major gradients g_a of the barycentric coordinates in the rest frame
+
+        void Add(int const i, int const j, int const k, glm::vec3 const & x0, glm::vec3 const & x1, glm::vec3 const & x2) {
+            glm::vec3 const e1 = x1 - x0, e2 = x2 - x0;
+            glm::vec3 const n  = glm::cross(e1, e2);
+            float const     area = .5f * glm::length(n);
+            if (area <= 0) return;
+            glm::vec3 const t = glm::normalize(e1);
+            glm::vec3 const u = glm::normalize(glm::cross(n, e1));
+            // rest shape in the triangle's own 2D frame; the rows of its inverse are g_1 and g_2
+            float const d00 = glm::dot(e1, t), d01 = glm::dot(e2, t);
+            float const d10 = glm::dot(e1, u), d11 = glm::dot(e2, u);
+            float const det = d00 * d11 - d01 * d10;
+            Elements.push_back({ i, j, k });
+            Weight.push_back(area);
+            Rest.push_back({ d11 / det, -d01 / det, -d10 / det, d00 / det });
+        }
+
+        void Prepare(std::size_t const particles) {
+            ConstraintBatch<3>::Prepare(particles);
+            std::size_t const m = Size();
+            GX.resize(3 * m);
+            GY.resize(3 * m);
+            for (std::size_t c = 0; c < m; c++) {
+                GX[m + c]     = Rest[c][0];
+                GY[m + c]     = Rest[c][1];
+                GX[2 * m + c] = Rest[c][2];
+                GY[2 * m + c] = Rest[c][3];
+                GX[c]         = -GX[m + c] - GX[2 * m + c];
+                GY[c]         = -GY[m + c] - GY[2 * m + c];
+            }
+        }
+
+        std::size_t MemoryBytes() const {
+            return ConstraintBatch<3>::MemoryBytes() + (GX.capacity() + GY.capacity()) * sizeof(float) + Rest.capacity() * sizeof(Rest[0]);
+        }
+
+        void Project(std::size_t const b, std::size_t const e) {
+            std::size_t const m = Size();
+            for (std::size_t c = b; c < e; c++) {
+                glm::vec3 f0(0), f1(0);
+                for (int a = 0; a < 3; a++) {
+                    std::size_t const s = a * m + c;
+                    glm::vec3 const   x(PX[s], PY[s], PZ[s]);
+                    f0 += x * GX[s];
+                    f1 += x * GY[s];
+                }
+                // eigen decomposition of C = F^T F, the singular values of F are the roots of its eigenvalues
+                float const c00 = glm::dot(f0, f0), c01 = glm::dot(f0, f1), c11 = glm::dot(f1, f1);
+                float const half = .5f * (c00 + c11);
+                float const disc = std::sqrt(std::max(.25f * (c00 - c11) * (c00 - c11) + c01 * c01, 0.f));
+                float const l1 = half + disc, l2 = std::max(half - disc, 0.f);
+                float const s1 = std::sqrt(l1), s2 = std::sqrt(l2);
+                float const t1 = std::clamp(s1, MinStretch, MaxStretch) / std::max(s1, 1e-12f);
+                float const t2 = std::clamp(s2, MinStretch, MaxStretch) / std::max(s2, 1e-12f);
+                // eigenvector of l1 from the better conditioned row of C - l1 I
+                float const ax = c01, ay = l1 - c00, bx = l1 - c11, by = c01;
+                bool const  useA = ax * ax + ay * ay >= bx * bx + by * by;
+                float       vx = useA ? ax : bx, vy = useA ? ay : by;
+                float const vn = std::sqrt(std::max(vx * vx + vy * vy, 1e-24f));
+                vx /= vn;
+                vy /= vn;
+                // P = F V diag(t) V^T, the residual is P - F
+                float const     d   = t1 - t2;
+                float const     s00 = t2 + d * vx * vx - 1, s01 = d * vx * vy, s11 = t2 + d * vy * vy - 1;
+                glm::vec3 const r0  = f0 * s00 + f1 * s01;
+                glm::vec3 const r1  = f0 * s01 + f1 * s11;
+                float const     w   = Stiffness * Weight[c];
+                Energy[c]           = .5f * w * (glm::dot(r0, r0) + glm::dot(r1, r1));
+                for (int a = 0; a < 3; a++) {
+                    std::size_t const s  = a * m + c;
+                    glm::vec3 const   fs = w * (r0 * GX[s] + r1 * GY[s]);
+                    FX[s]                = fs.x;
+                    FY[s]                = fs.y;
+                    FZ[s]                = fs.z;
+                }
+            }
+        }
+
+        template<typename Emit>
+        void Hessian(Emit && emit) const {
+            std::size_t const m = Size();
+            for (std::size_t c = 0; c < m; c++) {
+                float const w = Stiffness * Weight[c];
+                for (int a = 0; a < 3; a++)
+                    for (int d = 0; d < 3; d++)
+                        emit(Elements[c][a], Elements[c][d], w * (GX[a * m + c] * GX[d * m + c] + GY[a * m + c] * GY[d * m + c]));
+            }
+        }
+
+    private:
+        std::vector<std::array<float, 4>> Rest; // inverse of the rest shape matrix, row-major
+    };
+
+    // Volume preservation of a tet: the determinant of F = sum_a x_a g_a^T is limited to
+    // [MinVolume, MaxVolume] by moving its singular values to the nearest point of that set
+    // (Bouaziz et al. 2014). The 3 x 3 SVD has no closed form worth vectorizing, so this kernel runs
+    // per element, still in parallel over the blocks of the batch.
+    struct TetVolumeBatch : ConstraintBatch<4> {
+        float              MinVolume { .95f };
+        float              MaxVolume { 1.05f };
+        std::vector<float> GX, GY, GZ;
+
+        void Add(int const i, int const j, int const k, int const l, glm::vec3 const & x0, glm::vec3 const & x1, glm::vec3 const & x2, glm::vec3 const & x3) {
+            glm::mat3 const Dm(x1 - x0, x2 - x0, x3 - x0);
+            float const     volume = std::abs(glm::determinant(Dm)) / 6;
+            if (volume <= 0) return;
+            Elements.push_back({ i, j, k, l });
+            Weight.push_back(volume);
+            Rest.push_back(glm::inverse(Dm));
+        }
+
+        void Prepare(std::size_t const particles) {
+            ConstraintBatch<4>::Prepare(particles);
+            std::size_t const m = Size();
+            GX.resize(4 * m);
+            GY.resize(4 * m);
+            GZ.resize(4 * m);
+            for (std::size_t c = 0; c < m; c++) {
+                glm::vec3 g0(0);
+                for (int a = 1; a < 4; a++) {
+                    // F = Ds Dm^-1, so g_a is row a - 1 of Dm^-1
+                    glm::vec3 const g(Rest[c][0][a - 1], Rest[c][1][a - 1], Rest[c][2][a - 1]);
+                    GX[a * m + c] = g.x;
+                    GY[a * m + c] = g.y;
+                    GZ[a * m + c] = g.z;
+                    g0 -= g;
+                }
+                GX[c] = g0.x;
+                GY[c] = g0.y;
+                GZ[c] = g0.z;
+            }
+        }
+
+        std::size_t MemoryBytes() const {
+            return ConstraintBatch<4>::MemoryBytes() + (GX.capacity() + GY.capacity() + GZ.capacity()) * sizeof(float) + Rest.capacity() * sizeof(Rest[0]);
+        }
+
+        void Project(std::size_t const b, std::size_t const e) {
+            std::size_t const m = Size();
+            for (std::size_t c = b; c < e; c++) {
+                Eigen::Matrix3f F = Eigen::Matrix3f::Zero();
+                for (int a = 0; a < 4; a++) {
+                    std::size_t const s = a * m + c;
+                    F += Eigen::Vector3f(PX[s], PY[s], PZ[s]) * Eigen::RowVector3f(GX[s], GY[s], GZ[s]);
+                }
+                Eigen::Matrix3f residual = Eigen::Matrix3f::Zero();
+                float const     J        = F.determinant();
+                if (J < MinVolume || J > MaxVolume) {
+                    Eigen::JacobiSVD<Eigen::Matrix3f> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+                    Eigen::Matrix3f                   U = svd.matrixU(), V = svd.matrixV();
+                    Eigen::Vector3f                   sigma = svd.singularValues();
+                    // rotations only, an inverted tet keeps a negative singular value
+                    if (U.determinant() < 0) {
+                        U.col(2) *= -1;
+                        sigma[2] *= -1;
+                    }
+                    if (V.determinant() < 0) {
+                        V.col(2) *= -1;
+                        sigma[2] *= -1;
+                    }
+                    float const     target = std::clamp(J, MinVolume, MaxVolume);
+                    Eigen::Vector3f D      = Eigen::Vector3f::Zero();
+                    for (int it = 0; it < 4; it++) {
+                        Eigen::Vector3f const s    = sigma + D;
+                        Eigen::Vector3f const grad(s[1] * s[2], s[0] * s[2], s[0] * s[1]);
+                        float const           C = s.prod() - target;
+                        D                       = (grad.dot(D) - C) / std::max(grad.squaredNorm(), 1e-12f) * grad;
+                    }
+                    residual = U * (sigma + D).asDiagonal() * V.transpose() - F;
+                }
+                float const w = Stiffness * Weight[c];
+                Energy[c]     = .5f * w * residual.squaredNorm();
+                for (int a = 0; a < 4; a++) {
+                    std::size_t const     s  = a * m + c;
+                    Eigen::Vector3f const fs = w * residual * Eigen::Vector3f(GX[s], GY[s], GZ[s]);
+                    FX[s]                    = fs.x();
+                    FY[s]                    = fs.y();
+                    FZ[s]                    = fs.z();
+                }
+            }
+        }
+
+        template<typename Emit>
+        void Hessian(Emit && emit) const {
+            std::size_t const m = Size();
+            for (std::size_t c = 0; c < m; c++) {
+                float const w = Stiffness * Weight[c];
+                for (int a = 0; a < 4; a++)
+                    for (int d = 0; d < 4; d++)
+                        emit(Elements[c][a], Elements[c][d], w * (GX[a * m + c] * GX[d * m + c] + GY[a * m + c] * GY[d * m + c] + GZ[a * m + c] * GZ[d * m + c]));
+            }
+        }
+
+    private:
+        std::vector<glm::mat3> Rest; // inverse of the rest shape matrix
+    };
+} // namespace VCX::Labs::PD
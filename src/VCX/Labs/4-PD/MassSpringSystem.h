@@ -1,5 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <Eigen/Dense>
@@ -7,6 +14,10 @@
 #include <glm/glm.hpp>
 #include <iostream>
 
+#include "Labs/4-PD/Constraints.h"
+#include "Labs/4-PD/SelfCollision.h"
+#include "Labs/Common/Parallel.h"
+
 namespace VCX::Labs::PD {
     struct MassSpringSystem {
         struct Spring {
@@ -25,32 +36,372 @@ namespace VCX::Labs::PD {
         float               Damping { .2f };
         float               Gravity { .3f };
 
-        void prefactorize_lhs(float const dt, Eigen::SimplicialLLT<Eigen::SparseMatrix<float>>& solver) {
-            const int                          nDoFs = int(Positions.size()) * 3;
-            Eigen::SparseMatrix<float>         matLinearized(nDoFs, nDoFs);
+        // further constraint types, added with AddBending, AddTriangle and AddTet; a type whose
+        // stiffness is zero costs nothing
+        float                BendingStiffness { 0 };
+        float                StrainStiffness { 0 };
+        float                VolumeStiffness { 0 };
+        std::array<float, 2> StrainLimits { .95f, 1.05f }; // singular values of a triangle's deformation
+        std::array<float, 2> VolumeLimits { .95f, 1.05f }; // volume ratio of a tet
+
+        // the triangles given to AddTriangle also form the surface tested for self-collision
+        std::vector<std::array<int, 3>> Triangles;
+        bool                            EnableSelfCollision { false };
+        SelfCollision                   CollisionData;
+
+        enum class GlobalSolve {
+            Cholesky, // triangular solves with a sparse Cholesky factor of the global matrix
+            Jacobi,   // Chebyshev weighted Jacobi sweeps on the global matrix, no factorization
+        };
+
+        enum class Acceleration {
+            None,      // plain local-global iterations
+            Chebyshev, // semi-iterative weighting of the iterates, Wang 2015
+            Anderson,  // Anderson mixing of the last iterates with an energy safeguard, Peng et al. 2018
+        };
+
+        GlobalSolve Global { GlobalSolve::Cholesky };
+        int         JacobiIterations { 10 }; // sweeps per global step of the Jacobi solve
+
+        // local-global iterations run until the rms position update drops below Tolerance
+        Acceleration Accel { Acceleration::Chebyshev };
+        int          MaxIterations { 10 };
+        float        Tolerance { 1e-5f };
+        float        SpectralRadius { .9f };       // of the plain iteration, adapted from step to step when AutoSpectralRadius is set
+        bool         AutoSpectralRadius { true };
+        int          ChebyshevDelay { 2 };         // plain iterations before the acceleration starts
+        int          AndersonWindow { 5 };         // previous iterates mixed by Anderson acceleration
+        int          LastIterations { 0 };
+        float        LastUpdateNorm { 0 };
+        int          LastAndersonResets { 0 };     // accelerated iterates rejected by the energy check
+
+        // wall-clock seconds for the benchmarks: of the last refactorization, and of the local and
+        // global steps summed over the iterations of the last step
+        double LastFactorSeconds { 0 };
+        double LastLocalSeconds { 0 };
+        double LastGlobalSeconds { 0 };
+
+        // The global matrix M / h^2 + sum k w A^T A does not depend on the positions. It is factorized once and
+        // refactored only when the topology, Mass, a stiffness or the timestep changes, or when more than
+        // MaxPinUpdates particles were pinned or released since.
+        // It acts identically on x, y and z, so only the n x n scalar matrix is factorized and the
+        // three coordinates are solved as the columns of one right-hand side.
+        // Held by pointer because Eigen solvers cannot be moved and the case resets the system by assignment.
+        std::unique_ptr<Eigen::SimplicialLLT<Eigen::SparseMatrix<float>>> Solver;
+        bool                                                              TopologyChanged { true }; // set by AddParticle and the constraint adders
+        float                                                             FactoredMass { 0 };
+        std::array<float, 4>                                              FactoredStiffness {};
+        float                                                             FactoredDt { 0 };
+        GlobalSolve                                                       FactoredGlobal { GlobalSolve::Cholesky };
+        std::vector<int>                                                  FactoredFixed;
+        int                                                               MaxPinUpdates { 32 }; // pin changes corrected in place before a refactorization
+
+        // Particles pinned or released since the factorization are applied to the cached factor of
+        // A0 as low-rank corrections instead of refactoring, so grabbing a particle causes no hitch.
+        // Releasing particle p changes row and column p of the matrix, a rank-2 update
+        // e_p v_p^T + v_p e_p^T, and all of them together are A1 = A0 + U C U^T with U = [E, V] and
+        // C = [0 I; I 0], solved by the Woodbury identity. Newly pinned particles are constrained to
+        // zero displacement by a Schur complement on top of A1, which is the same as eliminating them.
+        struct PinCorrection {
+            std::vector<int>                     Released, Pinned;
+            Eigen::MatrixXf                      U, W; // n x 2r, W = A0^-1 U
+            Eigen::PartialPivLU<Eigen::MatrixXf> Capacitance; // C^-1 + U^T A0^-1 U, C^-1 = C
+            Eigen::MatrixXf                      Z;     // n x p, A1^-1 E
+            Eigen::LLT<Eigen::MatrixXf>          Schur; // E^T A1^-1 E
+            std::vector<int>                     Fixed; // the pinned set the correction was built for
+        } PinData;
+
+        SpringBatch         SpringData; // rebuilt from Springs with the topology
+        BendingBatch        BendingData;
+        TriangleStrainBatch StrainData;
+        TetVolumeBatch      VolumeData;
+
+        // M / h^2 + sum k w A^T A over all particles, pins not applied; the Cholesky factor, the
+        // Jacobi sweeps and the pin corrections all read it
+        Eigen::SparseMatrix<float, Eigen::RowMajor> SystemMatrix;
+
+        // particles as rows, coordinates as columns
+        using MatrixX3 = Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+        // Scratch of a step, sized with the topology (and the small pin blocks with the pin
+        // correction) so that a step allocates nothing after the first frame. The solvers view the
+        // vectors through Eigen::Map.
+        struct StepWorkspace {
+            std::vector<glm::vec3> Start;    // positions at the start of the step
+            std::vector<glm::vec3> Targets;  // inertial targets y
+            std::vector<glm::vec3> Diffs;    // right-hand side of the global step, then the update
+            std::vector<glm::vec3> Previous; // previous iterate of the Chebyshev recurrence, plain iterate of Anderson
+            // right-hand side in the order of the Cholesky factor, column-major because the sparse
+            // triangular solves copy a row-major right-hand side with more than one column
+            Eigen::Matrix<float, Eigen::Dynamic, 3> Permuted;
+            MatrixX3               Released; // U^T x and the capacitance solve of the Woodbury correction
+            MatrixX3               Capacity;
+            MatrixX3               Pinned;   // rows of the newly pinned particles
+        } Workspace;
+
+        void resize_workspace() {
+            std::size_t const n = Positions.size();
+            Workspace.Start.resize(n);
+            Workspace.Targets.resize(n);
+            Workspace.Diffs.resize(n);
+            Workspace.Previous.resize(n);
+            Workspace.Permuted.resize(Eigen::Index(n), 3);
+        }
+
+        // Every batch is visited through here, a new constraint type is registered by adding it.
+        template<typename Func>
+        void for_each_batch(Func && func) {
+            func(SpringData);
+            func(BendingData);
+            func(StrainData);
+            func(VolumeData);
+        }
+
+        template<typename Func>
+        void for_each_batch(Func && func) const {
+            func(SpringData);
+            func(BendingData);
+            func(StrainData);
+            func(VolumeData);
+        }
+
+        std::array<float, 4> batch_stiffness() const {
+            return { Stiffness, BendingStiffness, StrainStiffness, VolumeStiffness };
+        }
+
+        void sync_batch_parameters(SpringBatch & springs, BendingBatch & bending, TriangleStrainBatch & strain, TetVolumeBatch & volume) const {
+            springs.Stiffness = Stiffness;
+            bending.Stiffness = BendingStiffness;
+            strain.Stiffness  = StrainStiffness;
+            // The slider lets the two ends cross; std::clamp needs them ordered.
+            strain.MinStretch = std::min(StrainLimits[0], StrainLimits[1]);
+            strain.MaxStretch = std::max(StrainLimits[0], StrainLimits[1]);
+            volume.Stiffness  = VolumeStiffness;
+            volume.MinVolume  = std::min(VolumeLimits[0], VolumeLimits[1]);
+            volume.MaxVolume  = std::max(VolumeLimits[0], VolumeLimits[1]);
+        }
+
+        void sync_batch_parameters() {
+            sync_batch_parameters(SpringData, BendingData, StrainData, VolumeData);
+        }
+
+        std::size_t TopologyGeneration { 0 }; // counts the rebuilds of the batches
+
+        void build_batches() {
+            SpringData = {};
+            for (auto const & spring : Springs) SpringData.Add(int(spring.AdjIdx.first), int(spring.AdjIdx.second), spring.RestLength);
+            sync_batch_parameters();
+            for_each_batch([&](auto & batch) { batch.Prepare(Positions.size()); });
+            CollisionData.SetMesh(Positions.size(), Triangles, Positions);
+            resize_workspace();
+            TopologyGeneration++;
+        }
+
+        void build_system_matrix(float const dt) {
+            int const                          n = int(Positions.size());
             std::vector<Eigen::Triplet<float>> coefficients;
-            
-            const auto AddBlock = [&](int const p0, int const p1, glm::mat3 const & block) {
-                for (int i = 0; i < 3; i++)
-                    for (int j = 0; j < 3; j++)
-                        coefficients.emplace_back(p0 * 3 + i, p1 * 3 + j, block[j][i]);
-            };
+            for (int i = 0; i < n; i++) coefficients.emplace_back(i, i, Mass / dt / dt); // Mass term
+            for_each_batch([&](auto const & batch) {
+                if (batch.Active()) batch.Hessian([&](int const i, int const j, float const v) { coefficients.emplace_back(i, j, v); });
+            });
+            SystemMatrix.resize(n, n);
+            SystemMatrix.setFromTriplets(coefficients.begin(), coefficients.end());
+        }
+
+        // Local step: every active batch projects its constraints in parallel blocks, then the
+        // particles gather their slot forces.
+        void project_constraints() {
+            for_each_batch([&](auto & batch) {
+                if (! batch.Active()) return;
+                Common::ParallelForBlocks(0, batch.Size(), [&](std::size_t const b, std::size_t const e) {
+                    batch.Load(Positions, b, e);
+                    batch.Project(b, e);
+                }, 2048);
+            });
+        }
 
-            for (int i = 0; i < nDoFs; i++) coefficients.emplace_back(i, i, Mass / dt/ dt); // Mass term
+        glm::vec3 constraint_force(std::size_t const i) const {
+            glm::vec3 f(0);
+            for_each_batch([&](auto const & batch) {
+                if (batch.Active()) batch.Gather(i, f);
+            });
+            return f;
+        }
 
-            // Hessians
-            for (auto const & spring : Springs) {
-                auto const p0 = spring.AdjIdx.first;
-                auto const p1 = spring.AdjIdx.second;
-                AddBlock(p0, p0, glm::mat3(1.0));
-                AddBlock(p0, p1, -glm::mat3(1.0));
-                AddBlock(p1, p0, -glm::mat3(1.0));
-                AddBlock(p1, p1, glm::mat3(1.0));
+        // The factorization-free global step: Chebyshev weighted sweeps of relaxed Jacobi on the rows
+        // of the system matrix, in parallel over the particles and linear in its nonzeros. The
+        // eigenvalues of D^-1 A lie in [lo, hi], hi from the Gershgorin discs and lo from the same
+        // discs or from A >= M / h^2; relaxing by tau = 2 / (lo + hi) gives an iteration with the
+        // radius (hi - lo) / (hi + lo) < 1 for the Chebyshev weights, so they need no tuning and never
+        // diverge. For springs alone tau = 1, the plain Jacobi iteration.
+        struct JacobiState {
+            std::vector<float>     InvDiagonal;
+            std::vector<glm::vec3> Previous, Current, Next;
+            float                  Relaxation { 1 };
+            float                  Radius { 0 };
+        } JacobiData;
+
+        void prepare_jacobi(float const dt) {
+            std::size_t const n = Positions.size();
+            JacobiData.InvDiagonal.resize(n);
+            JacobiData.Previous.resize(n);
+            JacobiData.Current.resize(n);
+            JacobiData.Next.resize(n);
+            float coupling    = 0;
+            float maxDiagonal = Mass / dt / dt;
+            for (std::size_t i = 0; i < n; i++) {
+                float diagonal = Mass / dt / dt;
+                float coupled  = 0;
+                if (! Fixed[i]) {
+                    for (Eigen::SparseMatrix<float, Eigen::RowMajor>::InnerIterator it(SystemMatrix, Eigen::Index(i)); it; ++it) {
+                        if (it.col() == Eigen::Index(i)) diagonal = it.value();
+                        else if (! Fixed[it.col()]) coupled += std::abs(it.value());
+                    }
+                }
+                JacobiData.InvDiagonal[i] = 1 / diagonal;
+                coupling                  = std::max(coupling, coupled / diagonal);
+                maxDiagonal               = std::max(maxDiagonal, diagonal);
             }
+            float const lo          = std::max(1 - coupling, Mass / dt / dt / maxDiagonal);
+            float const hi          = 1 + coupling;
+            JacobiData.Relaxation   = 2 / (lo + hi);
+            JacobiData.Radius       = (hi - lo) / (hi + lo);
+        }
 
-            matLinearized.setFromTriplets(coefficients.begin(), coefficients.end());
-            solver.compute(matLinearized);
+        void jacobi_global_step(std::vector<glm::vec3> & rhs) {
+            auto &      jd   = JacobiData;
+            float const tau  = jd.Relaxation;
+            float const rho2 = jd.Radius * jd.Radius;
+            // x_0 = 0 and x_1 = tau D^-1 b
+            Common::ParallelFor(0, Positions.size(), [&](std::size_t const i) {
+                jd.Previous[i] = glm::vec3(0);
+                jd.Current[i]  = tau * rhs[i] * jd.InvDiagonal[i];
+            }, 1024);
+            float omega = 1;
+            for (int it = 1; it < JacobiIterations; it++) {
+                omega = it == 1 ? 2 / (2 - rho2) : 4 / (4 - rho2 * omega);
+                Common::ParallelFor(0, Positions.size(), [&](std::size_t const i) {
+                    glm::vec3 sum = rhs[i];
+                    if (! Fixed[i]) {
+                        for (Eigen::SparseMatrix<float, Eigen::RowMajor>::InnerIterator a(SystemMatrix, Eigen::Index(i)); a; ++a) {
+                            if (a.col() != Eigen::Index(i) && ! Fixed[a.col()]) sum -= a.value() * jd.Current[a.col()];
+                        }
+                    }
+                    glm::vec3 const relaxed = (1 - tau) * jd.Current[i] + tau * sum * jd.InvDiagonal[i];
+                    jd.Next[i]              = omega * (relaxed - jd.Previous[i]) + jd.Previous[i];
+                }, 1024);
+                std::swap(jd.Previous, jd.Current);
+                std::swap(jd.Current, jd.Next);
+            }
+            std::copy(jd.Current.begin(), jd.Current.end(), rhs.begin());
+        }
+
+        bool needs_refactorization(float const dt) const {
+            bool const stale = Global == GlobalSolve::Cholesky
+                ? ! Solver || Solver->rows() != Eigen::Index(Positions.size())
+                : JacobiData.InvDiagonal.size() != Positions.size();
+            if (TopologyChanged || stale || FactoredGlobal != Global || FactoredMass != Mass || FactoredStiffness != batch_stiffness() || FactoredDt != dt) return true;
+            if (Global == GlobalSolve::Jacobi) return false; // pins only change the diagonal bounds, see prepare_global_step
+            if (FactoredFixed.size() != Fixed.size()) return true;
+            int changed = 0;
+            for (std::size_t i = 0; i < Fixed.size(); i++) changed += (! FactoredFixed[i]) != (! Fixed[i]);
+            return changed > MaxPinUpdates;
+        }
+
+        // A1^-1 B with the Woodbury correction for the released particles
+        Eigen::MatrixXf solve_released(Eigen::MatrixXf const & B) const {
+            Eigen::MatrixXf Y = Solver->solve(B);
+            if (! PinData.Released.empty()) Y -= PinData.W * PinData.Capacitance.solve(PinData.U.transpose() * Y);
+            return Y;
+        }
+
+        void build_pin_correction() {
+            Eigen::Index const n = Eigen::Index(Positions.size());
+            PinData.Released.clear();
+            PinData.Pinned.clear();
+            for (std::size_t i = 0; i < Fixed.size(); i++) {
+                if (FactoredFixed[i] && ! Fixed[i]) PinData.Released.push_back(int(i));
+                if (! FactoredFixed[i] && Fixed[i]) PinData.Pinned.push_back(int(i));
+            }
+            PinData.Fixed = Fixed;
+
+            int const r = int(PinData.Released.size());
+            if (r > 0) {
+                PinData.U.setZero(n, 2 * r);
+                for (int a = 0; a < r; a++) {
+                    int const p = PinData.Released[a];
+                    PinData.U(p, a) = 1;
+                    // v_p is column p of the change with the diagonal halved; a coupling between two
+                    // released particles appears in both of their columns and is halved as well
+                    auto v = PinData.U.col(r + a);
+                    for (Eigen::SparseMatrix<float, Eigen::RowMajor>::InnerIterator it(SystemMatrix, p); it; ++it) {
+                        int const other = int(it.col());
+                        if (other == p) v[p] += .5f * (it.value() - FactoredMass / FactoredDt / FactoredDt);
+                        else if (FactoredFixed[other] && Fixed[other]) continue;
+                        else v[other] += FactoredFixed[other] ? .5f * it.value() : it.value();
+                    }
+                }
+                PinData.W                     = Solver->solve(PinData.U);
+                Eigen::MatrixXf capacitance   = PinData.U.transpose() * PinData.W;
+                capacitance.topRightCorner(r, r).diagonal().array() += 1;
+                capacitance.bottomLeftCorner(r, r).diagonal().array() += 1;
+                PinData.Capacitance.compute(capacitance);
+                Workspace.Released.resize(2 * r, 3);
+                Workspace.Capacity.resize(2 * r, 3);
+            }
+
+            int const pinned = int(PinData.Pinned.size());
+            if (pinned > 0) {
+                Eigen::MatrixXf E = Eigen::MatrixXf::Zero(n, pinned);
+                for (int a = 0; a < pinned; a++) E(PinData.Pinned[a], a) = 1;
+                PinData.Z = solve_released(E);
+                Eigen::MatrixXf schur(pinned, pinned);
+                for (int a = 0; a < pinned; a++) schur.row(a) = PinData.Z.row(PinData.Pinned[a]);
+                PinData.Schur.compute(schur);
+                Workspace.Pinned.resize(pinned, 3);
+            }
+        }
+
+        static double seconds_since(std::chrono::steady_clock::time_point const start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void prefactorize_lhs(float const dt) {
+            auto const start = std::chrono::steady_clock::now();
+
+            FactoredGlobal    = Global;
+            TopologyChanged   = false;
+            FactoredMass      = Mass;
+            FactoredStiffness = batch_stiffness();
+            FactoredDt        = dt;
+            FactoredFixed     = Fixed;
+            build_system_matrix(dt);
+            if (Global == GlobalSolve::Jacobi) {
+                prepare_jacobi(dt);
+                LastFactorSeconds = seconds_since(start);
+                return;
+            }
+
+            // pinned particles are eliminated so that their rows solve to zero displacement
+            const int                          n = int(Positions.size());
+            Eigen::SparseMatrix<float>         matLinearized(n, n);
+            std::vector<Eigen::Triplet<float>> coefficients;
+            coefficients.reserve(SystemMatrix.nonZeros());
+            for (int i = 0; i < n; i++) {
+                for (Eigen::SparseMatrix<float, Eigen::RowMajor>::InnerIterator it(SystemMatrix, i); it; ++it) {
+                    int const j = int(it.col());
+                    if (i == j) coefficients.emplace_back(i, i, Fixed[i] ? Mass / dt / dt : it.value());
+                    else if (! Fixed[i] && ! Fixed[j]) coefficients.emplace_back(i, j, it.value());
+                }
+            }
 
+            matLinearized.setFromTriplets(coefficients.begin(), coefficients.end());
+            if (! Solver) Solver = std::make_unique<Eigen::SimplicialLLT<Eigen::SparseMatrix<float>>>();
+            Solver->compute(matLinearized);
+            PinData.Released.clear();
+            PinData.Pinned.clear();
+            PinData.Fixed     = Fixed;
+            LastFactorSeconds = seconds_since(start);
         }
 
         void AddParticle(glm::vec3 const & position, glm::vec3 const & velocity = glm::vec3(0)) {
@@ -58,6 +409,7 @@ namespace VCX::Labs::PD {
             Velocities.push_back(velocity);
             Fixed.push_back(false);
             Forces.push_back(glm::vec3(0));
+            TopologyChanged = true;
         }
 
         void AddSpring(std::size_t const adjIdx0, std::size_t const adjIdx1, float const restLength = -1) {
@@ -65,105 +417,507 @@ namespace VCX::Labs::PD {
                 .AdjIdx { adjIdx0, adjIdx1 },
                 .RestLength { restLength < 0 ? glm::length(Positions[adjIdx0] - Positions[adjIdx1]) : restLength }
             });
+            TopologyChanged = true;
         }
 
-        void AdvanceMassSpringSystem(float const dt) {
-            int total_steps = 3;
+        // second difference along the line i, j, k, kept at its rest length
+        void AddBending(std::size_t const i, std::size_t const j, std::size_t const k) {
+            BendingData.Add(int(i), int(j), int(k), glm::length(Positions[i] - 2.f * Positions[j] + Positions[k]));
+            TopologyChanged = true;
+        }
 
-            // save original positions
-            std::vector<glm::vec3> original_positions(Positions);
+        // strain limiting of the triangle i, j, k at its current shape
+        void AddTriangle(std::size_t const i, std::size_t const j, std::size_t const k) {
+            StrainData.Add(int(i), int(j), int(k), Positions[i], Positions[j], Positions[k]);
+            Triangles.push_back({ int(i), int(j), int(k) });
+            TopologyChanged = true;
+        }
 
-            std::vector<glm::vec3> f_ext(Positions.size(), glm::vec3(0, -Gravity, 0) * Mass);
+        // volume preservation of the tet i, j, k, l at its current shape
+        void AddTet(std::size_t const i, std::size_t const j, std::size_t const k, std::size_t const l) {
+            VolumeData.Add(int(i), int(j), int(k), int(l), Positions[i], Positions[j], Positions[k], Positions[l]);
+            TopologyChanged = true;
+        }
 
-            // add damping force
-            for (std::size_t i = 0; i < Positions.size(); i++) {
-                f_ext[i] += -Damping * Velocities[i];
+        // Local step: projects the constraints at the current positions and writes the right-hand side
+        // M / h^2 (y - x) + f_int of the global step to rhs. Returns the energy
+        // M / (2 h^2) |x - y|^2 + sum k w / 2 |A x - p|^2 that the local-global iterations decrease.
+        double local_step(float const dt, std::vector<glm::vec3> const & target_positions, std::vector<glm::vec3> & rhs) {
+            auto const start = std::chrono::steady_clock::now();
+            project_constraints();
+
+            double const inertia = Common::ParallelSum(0, Positions.size(), 0.0, [&](std::size_t const i) {
+                if (Fixed[i]) {
+                    rhs[i] = glm::vec3(0);
+                    return 0.0;
+                }
+                glm::vec3 const d = target_positions[i] - Positions[i];
+                rhs[i]            = Mass * d / dt / dt + constraint_force(i);
+                return double(glm::dot(d, d));
+            });
+            double elastic = 0;
+            for_each_batch([&](auto const & batch) {
+                if (batch.Active()) elastic += batch.TotalEnergy();
+            });
+            LastLocalSeconds += seconds_since(start);
+            return .5 * Mass / dt / dt * inertia + elastic;
+        }
+
+        // Global step: replaces the right-hand side by the position update, one pair of triangular
+        // solves with the cached factor or a fixed number of Jacobi sweeps.
+        void global_step(std::vector<glm::vec3> & rhs) {
+            auto const start = std::chrono::steady_clock::now();
+            if (Global == GlobalSolve::Jacobi) jacobi_global_step(rhs);
+            else cholesky_global_step(rhs);
+            LastGlobalSeconds += seconds_since(start);
+        }
+
+        void cholesky_global_step(std::vector<glm::vec3> & rhs) {
+            // the steps of Solver->solve, spelled out so that the permutations do not allocate
+            auto & ws      = Workspace;
+            auto   vec_rhs = Eigen::Map<MatrixX3>(reinterpret_cast<float *>(rhs.data()), Eigen::Index(Positions.size()), 3);
+            ws.Permuted.noalias() = Solver->permutationP() * vec_rhs;
+            Solver->matrixL().solveInPlace(ws.Permuted);
+            Solver->matrixU().solveInPlace(ws.Permuted);
+            vec_rhs.noalias() = Solver->permutationPinv() * ws.Permuted;
+            if (! PinData.Released.empty()) {
+                ws.Released.noalias() = PinData.U.transpose() * vec_rhs;
+                ws.Capacity           = PinData.Capacitance.solve(ws.Released);
+                vec_rhs.noalias() -= PinData.W * ws.Capacity;
+            }
+            if (! PinData.Pinned.empty()) {
+                for (std::size_t a = 0; a < PinData.Pinned.size(); a++) ws.Pinned.row(a) = vec_rhs.row(PinData.Pinned[a]);
+                PinData.Schur.solveInPlace(ws.Pinned);
+                vec_rhs.noalias() -= PinData.Z * ws.Pinned;
             }
+        }
 
-            // add force exerted by user
-            for (std::size_t i = 0; i < Positions.size(); i++) {
-                f_ext[i] += Forces[i];
-                Forces[i] = glm::vec3(0);
+        // One local-global iteration from the current positions. Writes the displacement of the plain
+        // PD update to diffs without applying it.
+        void local_global_step(float const dt, std::vector<glm::vec3> const & target_positions, std::vector<glm::vec3> & diffs) {
+            local_step(dt, target_positions, diffs);
+            global_step(diffs);
+        }
+
+        // Anderson acceleration treats one local-global iteration as a fixed-point map G(x) = x + dx
+        // and extrapolates from the last AndersonWindow residuals f = dx: it finds the gamma that
+        // minimizes |f_k - dF gamma| over the residual differences dF and moves to G(x_k) - dG gamma.
+        // The least-squares problem is kept as a thin QR factorization of dF that is extended by
+        // Gram-Schmidt when an iteration adds a column and downdated by Givens rotations when the
+        // oldest column leaves the window, so every iteration costs O(3n window).
+        struct AndersonHistory {
+            Eigen::MatrixXf Q;  // 3n x window, orthonormal basis of the residual differences
+            Eigen::MatrixXf R;  // window x window, upper triangular, dF = Q R
+            Eigen::MatrixXf DG; // 3n x window, differences of the plain iterates
+            Eigen::VectorXf F;  // residual of the previous iteration
+            Eigen::VectorXf G;  // plain iterate of the previous iteration, the fallback of the safeguard
+            Eigen::VectorXf Gamma;
+            int             Columns { 0 };
+            bool            HasPrevious { false };
+        } AndersonData;
+
+        void anderson_reset() {
+            Eigen::Index const rows   = Eigen::Index(3 * Positions.size());
+            int const          window = std::max(AndersonWindow, 1);
+            if (AndersonData.Q.rows() != rows || AndersonData.Q.cols() != window) {
+                AndersonData.Q.resize(rows, window);
+                AndersonData.DG.resize(rows, window);
+                AndersonData.R.resize(window, window);
+                AndersonData.F.resize(rows);
+                AndersonData.G.resize(rows);
+                AndersonData.Gamma.resize(window);
             }
+            AndersonData.Columns     = 0;
+            AndersonData.HasPrevious = false;
+        }
 
-            for (std::size_t i = 0; i < Positions.size(); i++) {
-                if (Fixed[i]) f_ext[i] = glm::vec3(0);
+        void anderson_drop_oldest() {
+            auto &    Q = AndersonData.Q;
+            auto &    R = AndersonData.R;
+            int const j = AndersonData.Columns;
+            // without its first column R is upper Hessenberg; rotate it back to triangular and apply
+            // the same rotations to the columns of Q so that Q R is unchanged
+            for (int c = 0; c + 1 < j; c++) R.col(c).head(j) = R.col(c + 1).head(j);
+            for (int i = 0; i + 1 < j; i++) {
+                Eigen::JacobiRotation<float> rotation;
+                rotation.makeGivens(R(i, i), R(i + 1, i));
+                R.block(0, 0, j, j - 1).applyOnTheLeft(i, i + 1, rotation.adjoint());
+                Q.applyOnTheRight(i, i + 1, rotation);
             }
+            for (int c = 0; c + 1 < j; c++) AndersonData.DG.col(c) = AndersonData.DG.col(c + 1);
+            AndersonData.Columns = j - 1;
+        }
 
-            std::vector<glm::vec3> target_positions(Positions.size(),glm::vec3(0, 0, 0)); // y-x
-            
-            for (std::size_t i = 0; i < Positions.size(); i++) {
-                target_positions[i] = original_positions[i] + (Velocities[i] + dt * f_ext[i] / Mass) * dt;
+        // Records the residual f and plain iterate g of this iteration and writes the accelerated
+        // iterate to x.
+        void anderson_mix(Eigen::Ref<Eigen::VectorXf const> const & f, Eigen::Ref<Eigen::VectorXf const> const & g, Eigen::Ref<Eigen::VectorXf> x) {
+            auto & aa = AndersonData;
+            if (aa.HasPrevious) {
+                if (aa.Columns == aa.Q.cols()) anderson_drop_oldest();
+                int const j = aa.Columns;
+                aa.Q.col(j) = f - aa.F;
+                aa.DG.col(j) = g - aa.G;
+                aa.R.col(j).setZero();
+                float const norm = aa.Q.col(j).norm();
+                // Gram-Schmidt twice keeps Q orthonormal in single precision
+                for (int pass = 0; pass < 2; pass++) {
+                    for (int i = 0; i < j; i++) {
+                        float const r = aa.Q.col(i).dot(aa.Q.col(j));
+                        aa.R(i, j) += r;
+                        aa.Q.col(j) -= r * aa.Q.col(i);
+                    }
+                }
+                float const rest = aa.Q.col(j).norm();
+                // a difference that is (nearly) in the span of the window adds nothing
+                if (rest > 1e-4f * norm && rest > 0) {
+                    aa.R(j, j) = rest;
+                    aa.Q.col(j) /= rest;
+                    aa.Columns = j + 1;
+                }
+            }
+            aa.F           = f;
+            aa.G           = g;
+            aa.HasPrevious = true;
+
+            int const j = aa.Columns;
+            if (j == 0) {
+                x = g;
+                return;
             }
+            auto gamma = aa.Gamma.head(j);
+            gamma.noalias() = aa.Q.leftCols(j).transpose() * f;
+            aa.R.topLeftCorner(j, j).triangularView<Eigen::Upper>().solveInPlace(gamma);
+            x = g;
+            x.noalias() -= aa.DG.leftCols(j) * gamma;
+        }
 
-            while(total_steps--) {
+        // Chebyshev weight of iteration k since the last (re)start (Wang 2015): plain iterations before
+        // ChebyshevDelay, then the recurrence omega = 4 / (4 - rho^2 omega).
+        float chebyshev_omega(int const k, float const omega) const {
+            float const rho2 = SpectralRadius * SpectralRadius;
+            if (k <= ChebyshevDelay) return 1;
+            if (k == ChebyshevDelay + 1) return 2 / (2 - rho2);
+            return 4 / (4 - rho2 * omega);
+        }
 
-                std::vector<glm::vec3> target_diffs(Positions.size(),glm::vec3(0, 0, 0)); // y-x
-                
-                for (std::size_t i = 0; i < Positions.size(); i++) {
-                    target_diffs[i] = target_positions[i] - Positions[i];
+        // plain or Chebyshev accelerated local-global iterations
+        void semi_iterations(float const dt, std::vector<glm::vec3> const & target_positions, std::vector<glm::vec3> & target_diffs) {
+            auto & previous_positions = Workspace.Previous; // q_{k-1} of the Chebyshev recurrence
+            std::copy(Positions.begin(), Positions.end(), previous_positions.begin());
+            bool const             chebyshev  = Accel == Acceleration::Chebyshev;
+            float                  omega      = 1;
+            float                  lastUpdate = 0;
+            int                    phase      = 0; // iterations since the recurrence (re)started
+            bool                   restarted  = false;
+            for (int k = 0; k < MaxIterations; k++, phase++) {
+                local_global_step(dt, target_positions, target_diffs);
+
+                float const update = std::sqrt(Common::ParallelSum(0, Positions.size(), 0.0, [&](std::size_t const i) {
+                    return double(glm::dot(target_diffs[i], target_diffs[i]));
+                }) / std::max<std::size_t>(Positions.size(), 1));
+                // the nonlinear springs make the usable radius depend on the state; when an accelerated
+                // iterate is worse than its predecessor the recurrence restarts with a smaller radius;
+                // updates at the level of float round-off are not compared
+                if (chebyshev && phase > ChebyshevDelay && update > lastUpdate && update > std::max(Tolerance, 1e-6f)) {
+                    phase     = 0;
+                    restarted = true;
+                    if (AutoSpectralRadius) SpectralRadius *= .9f;
                 }
-            
-                const int                          nDoFs = int(Positions.size()) * 3;
-
-                std::vector<glm::vec3> f_ints(Positions.size(), glm::vec3(0, 0, 0));
-                for (auto const & spring : Springs) {
-                    auto const p0 = spring.AdjIdx.first;
-                    auto const p1 = spring.AdjIdx.second;
-                    // if (Fixed[p0] && Fixed[p1]) continue;
-
-                    glm::vec3 const x0   = Positions[p0];
-                    glm::vec3 const x1   = Positions[p1];
-                    glm::vec3 const x01   = x1 - x0;
-                    glm::vec3 const e01   = glm::normalize(x01);
-                    float const    l      = glm::length(x01);
-
-                    glm::vec3 xe0 = x0 + ((l - spring.RestLength) / 2.0f) * e01;
-                    glm::vec3 xe1 = x1 - ((l - spring.RestLength) / 2.0f) * e01;
-
-                    if (Fixed[p0] && !Fixed[p1]) {
-                        xe0 = x0;
-                        xe1 = x1 - e01 * (l - spring.RestLength);
-                    }
-                    else if(!Fixed[p0] && Fixed[p1]) {
-                        xe0 = x0 + e01 * (l - spring.RestLength);
-                        xe1 = x1;
-                    }
 
-                    if (!Fixed[p0])
-                        f_ints[p0] -= Stiffness * (x0 - x1 - (xe0 - xe1));
-                    if (!Fixed[p1])
-                        f_ints[p1] -= Stiffness * (x1 - x0 - (xe1 - xe0));
+                omega = chebyshev ? chebyshev_omega(phase, omega) : 1;
+                Common::ParallelFor(0, Positions.size(), [&](std::size_t const i) {
+                    glm::vec3 const q = Positions[i];
+                    Positions[i]          = omega * (q + target_diffs[i] - previous_positions[i]) + previous_positions[i];
+                    previous_positions[i] = q;
+                });
+
+                LastIterations   = k + 1;
+                LastUpdateNorm   = update;
+                lastUpdate       = update;
+                if (update <= Tolerance) break;
+            }
+            // and creeps back up over the steps that converged smoothly
+            if (chebyshev && AutoSpectralRadius && ! restarted)
+                SpectralRadius = std::min(SpectralRadius + .05f * (1 - SpectralRadius), .999f);
+        }
 
+        void anderson_iterations(float const dt, std::vector<glm::vec3> const & target_positions, std::vector<glm::vec3> & target_diffs) {
+            Eigen::Index const size = Eigen::Index(3 * Positions.size());
+            auto               x    = Eigen::Map<Eigen::VectorXf>(reinterpret_cast<float *>(Positions.data()), size);
+            auto               f    = Eigen::Map<Eigen::VectorXf>(reinterpret_cast<float *>(target_diffs.data()), size);
+            auto               g    = Eigen::Map<Eigen::VectorXf>(reinterpret_cast<float *>(Workspace.Previous.data()), size);
+
+            anderson_reset();
+            LastAndersonResets = 0;
+            double lastEnergy  = std::numeric_limits<double>::infinity();
+            bool   accelerated = false;
+            for (int k = 0; k < MaxIterations; k++) {
+                double energy = local_step(dt, target_positions, target_diffs);
+                // Safeguard: the plain iteration never increases the energy, an accelerated iterate
+                // that does is replaced by the plain iterate of the previous iteration and the history
+                // starts over
+                if (accelerated && energy > lastEnergy) {
+                    x = AndersonData.G;
+                    anderson_reset();
+                    LastAndersonResets++;
+                    energy = local_step(dt, target_positions, target_diffs);
                 }
+                global_step(target_diffs);
 
-                auto vec_target_diffs = Eigen::Map<Eigen::VectorXf, Eigen::Aligned>(reinterpret_cast<float *>(target_diffs.data()), nDoFs);
-                auto vec_f_ints     = Eigen::Map<Eigen::VectorXf, Eigen::Aligned>(reinterpret_cast<float *>(f_ints.data()), nDoFs);
+                float const update = f.norm() / std::sqrt(float(std::max<std::size_t>(Positions.size(), 1)));
+                g = x + f;
+                anderson_mix(f, g, x);
+                accelerated = AndersonData.Columns > 0;
+                lastEnergy  = energy;
 
-                Eigen::VectorXf rhsLinearized = Mass*vec_target_diffs/dt/dt + vec_f_ints;
-
-                Eigen::SimplicialLLT<Eigen::SparseMatrix<float>> solver;
-                prefactorize_lhs(dt,solver);
+                LastIterations = k + 1;
+                LastUpdateNorm = update;
+                if (update <= Tolerance) break;
+            }
+        }
 
-                // prefactorize_lhs(dt);
-                vec_target_diffs = solver.solve(rhsLinearized);
+        // refactors the global matrix or corrects the factor for the pins changed since
+        void prepare_global_step(float const dt) {
+            sync_batch_parameters();
+            if (needs_refactorization(dt)) {
+                if (TopologyChanged || SpringData.Size() != Springs.size()) build_batches();
+                prefactorize_lhs(dt);
+            } else if (Global == GlobalSolve::Cholesky && PinData.Fixed != Fixed) {
+                build_pin_correction();
+            } else if (Global == GlobalSolve::Jacobi && FactoredFixed != Fixed) {
+                // the system matrix does not depend on the pins, the sweeps mask the pinned rows and
+                // columns, so only the relaxation bounds are recomputed
+                FactoredFixed = Fixed;
+                prepare_jacobi(dt);
+            }
+        }
 
-                // print matLinearized and rhsLinearized for debugging
-                // std::cout << "matLinearized:" << matLinearized << std::endl;
-                // std::cout << "rhsLinearized:" << rhsLinearized << std::endl;
+        void AdvanceMassSpringSystem(float const dt) {
+            LastLocalSeconds  = 0;
+            LastGlobalSeconds = 0;
+            prepare_global_step(dt);
 
+            // save original positions
+            auto & original_positions = Workspace.Start;
+            std::copy(Positions.begin(), Positions.end(), original_positions.begin());
 
-                for (std::size_t i = 0; i < Positions.size(); i++) {
-                    for (int j = 0; j < 3; j++)
-                        Positions[i][j] += vec_target_diffs[i*3+j];
-                }
+            auto & target_positions = Workspace.Targets;
+            for (std::size_t i = 0; i < Positions.size(); i++) {
+                // gravity, damping and the force exerted by the user
+                glm::vec3 const f_ext = Fixed[i] ? glm::vec3(0) : glm::vec3(0, -Gravity, 0) * Mass - Damping * Velocities[i] + Forces[i];
+                Forces[i]             = glm::vec3(0);
+                target_positions[i]   = original_positions[i] + (Velocities[i] + dt * f_ext / Mass) * dt;
             }
 
+            auto & target_diffs = Workspace.Diffs;
+            if (Accel == Acceleration::Anderson) anderson_iterations(dt, target_positions, target_diffs);
+            else semi_iterations(dt, target_positions, target_diffs);
+
+            if (EnableSelfCollision) CollisionData.Resolve(original_positions, Positions, Fixed);
+
             for (std::size_t i = 0; i < Positions.size(); i++) {
                 Velocities[i] = (Positions[i]-original_positions[i]) / dt;
             }
 
         }
-        
+
+        // Approximate heap memory of the state, the batches, the global matrix and its factor and the
+        // solver scratch, for the benchmarks.
+        std::size_t MemoryBytes() const {
+            auto const bytes = [](auto const & v) { return v.capacity() * sizeof(typename std::decay_t<decltype(v)>::value_type); };
+            std::size_t total = bytes(Positions) + bytes(Velocities) + bytes(Forces) + bytes(Fixed) + bytes(Springs) + bytes(Triangles);
+            for_each_batch([&](auto const & batch) { total += batch.MemoryBytes(); });
+            total += std::size_t(SystemMatrix.nonZeros()) * (sizeof(float) + sizeof(int)) + std::size_t(SystemMatrix.outerSize() + 1) * sizeof(int);
+            if (Solver && FactoredGlobal == GlobalSolve::Cholesky) {
+                auto const & L = Solver->matrixL().nestedExpression();
+                total += std::size_t(L.nonZeros()) * (sizeof(float) + sizeof(int)) + std::size_t(L.outerSize() + 1) * sizeof(int);
+                total += 2 * std::size_t(Solver->permutationP().size()) * sizeof(int);
+            }
+            total += bytes(JacobiData.InvDiagonal) + bytes(JacobiData.Previous) + bytes(JacobiData.Current) + bytes(JacobiData.Next);
+            total += bytes(Workspace.Start) + bytes(Workspace.Targets) + bytes(Workspace.Diffs) + bytes(Workspace.Previous);
+            total += std::size_t(Workspace.Permuted.size()) * sizeof(float);
+            for (auto const * m : { &AndersonData.Q, &AndersonData.R, &AndersonData.DG }) total += std::size_t(m->size()) * sizeof(float);
+            return total;
+        }
+
+        // Parameter sweeps step many copies of the system that share its topology, parameters, pins
+        // and global matrix, and differ only in their state and the forces applied to them. An
+        // instance is stepped like the system itself with the plain local-global iterations (the
+        // acceleration schemes adapt per-system state from step to step) and without self-collision.
+        struct Instance {
+            std::vector<glm::vec3> Positions;
+            std::vector<glm::vec3> Velocities;
+            std::vector<glm::vec3> Forces;
+        };
+
+        // The instances are split into one contiguous range per worker of the thread pool. A worker
+        // projects into its own copy of the batches, and solves the right-hand sides of its whole
+        // range as one block of columns of InstanceRhs with the shared factor. The copies are taken
+        // again only when the batches were rebuilt, and the scratch of the global solve is kept with
+        // the worker, so a sweep allocates nothing after its first step.
+        struct InstanceWorker {
+            SpringBatch         SpringData;
+            BendingBatch        BendingData;
+            TriangleStrainBatch StrainData;
+            TetVolumeBatch      VolumeData;
+            std::size_t         Generation { 0 }; // TopologyGeneration of the copies
+
+            Eigen::MatrixXf Permuted, Released, Capacity, Pinned; // Cholesky solve, as in StepWorkspace
+            Eigen::MatrixXf Previous, Current, Next;              // Jacobi iterates
+            Eigen::VectorXf Free;                                 // 0 on the pinned rows, 1 elsewhere
+            int             Iterations { 0 };
+            float           Update { 0 };
+        };
+
+        // A^-1 B in place for the pinned set, the steps of cholesky_global_step on a block of columns
+        void solve_pinned(Eigen::Ref<Eigen::MatrixXf> B, InstanceWorker & ws) const {
+            ws.Permuted.noalias() = Solver->permutationP() * B;
+            Solver->matrixL().solveInPlace(ws.Permuted);
+            Solver->matrixU().solveInPlace(ws.Permuted);
+            B.noalias() = Solver->permutationPinv() * ws.Permuted;
+            if (! PinData.Released.empty()) {
+                ws.Released.noalias() = PinData.U.transpose() * B;
+                ws.Capacity           = PinData.Capacitance.solve(ws.Released);
+                B.noalias() -= PinData.W * ws.Capacity;
+            }
+            if (! PinData.Pinned.empty()) {
+                ws.Pinned.resize(Eigen::Index(PinData.Pinned.size()), B.cols());
+                for (std::size_t a = 0; a < PinData.Pinned.size(); a++) ws.Pinned.row(a) = B.row(PinData.Pinned[a]);
+                PinData.Schur.solveInPlace(ws.Pinned);
+                B.noalias() -= PinData.Z * ws.Pinned;
+            }
+        }
+
+        // The Jacobi global step in place on a block of right-hand side columns, without the thread
+        // pool. A pinned row keeps zero displacement, so its couplings need not be skipped.
+        void jacobi_solve(Eigen::Ref<Eigen::MatrixXf> B, InstanceWorker & ws) const {
+            auto const &       jd  = JacobiData;
+            Eigen::Index const n   = B.rows();
+            auto const         inv = Eigen::Map<Eigen::VectorXf const>(jd.InvDiagonal.data(), n);
+            ws.Free.resize(n);
+            for (Eigen::Index i = 0; i < n; i++) ws.Free[i] = Fixed[i] ? 0.f : 1.f;
+            float const tau  = jd.Relaxation;
+            float const rho2 = jd.Radius * jd.Radius;
+            ws.Previous.setZero(n, B.cols());
+            ws.Current = tau * (B.array().colwise() * inv.array()).matrix();
+            float omega = 1;
+            for (int it = 1; it < JacobiIterations; it++) {
+                omega = it == 1 ? 2 / (2 - rho2) : 4 / (4 - rho2 * omega);
+                ws.Next.noalias() = SystemMatrix * ws.Current;
+                // (1 - tau) x + tau D^-1 (b - A x + D x) = x + tau D^-1 (b - A x)
+                ws.Next = ws.Current + tau * ((B - ws.Next).array().colwise() * inv.array()).matrix();
+                ws.Next = ((omega * (ws.Next - ws.Previous) + ws.Previous).array().colwise() * ws.Free.array()).matrix();
+                ws.Previous.swap(ws.Current);
+                ws.Current.swap(ws.Next);
+            }
+            B = ws.Current;
+        }
+
+        std::vector<InstanceWorker> InstanceWorkers;
+        Eigen::MatrixXf             InstanceRhs;     // n x 3N, instance k in the columns 3k, 3k + 1, 3k + 2
+        Eigen::MatrixXf             InstanceTargets; // inertial targets y, laid out like InstanceRhs
+        Eigen::MatrixXf             InstanceStart;   // positions at the start of the step
+
+        void AdvanceInstances(float const dt, std::vector<Instance> & instances) {
+            if (instances.empty()) return;
+            prepare_global_step(dt);
+            Eigen::Index const n = Eigen::Index(Positions.size());
+            Eigen::Index const m = Eigen::Index(instances.size());
+            InstanceRhs.resize(n, 3 * m);
+            InstanceTargets.resize(n, 3 * m);
+            InstanceStart.resize(n, 3 * m);
+
+            auto &            pool     = Common::ThreadPool::Instance();
+            std::size_t const nWorkers = std::min(instances.size(), pool.Concurrency());
+            InstanceWorkers.resize(nWorkers);
+            for (auto & worker : InstanceWorkers) {
+                if (worker.Generation != TopologyGeneration) {
+                    worker.SpringData  = SpringData;
+                    worker.BendingData = BendingData;
+                    worker.StrainData  = StrainData;
+                    worker.VolumeData  = VolumeData;
+                    worker.Generation  = TopologyGeneration;
+                }
+                sync_batch_parameters(worker.SpringData, worker.BendingData, worker.StrainData, worker.VolumeData);
+                worker.Iterations = 0;
+                worker.Update     = 0;
+            }
+
+            pool.ForChunks(0, instances.size(), nWorkers, [&](std::size_t const w, std::size_t const b, std::size_t const e) {
+                auto &             worker = InstanceWorkers[w];
+                Eigen::Index const col    = Eigen::Index(3 * b);
+                Eigen::Index const cols   = Eigen::Index(3 * (e - b));
+                auto const         for_each_worker_batch = [&](auto && func) {
+                    func(worker.SpringData);
+                    func(worker.BendingData);
+                    func(worker.StrainData);
+                    func(worker.VolumeData);
+                };
+
+                for (std::size_t k = b; k < e; k++) {
+                    auto & inst = instances[k];
+                    for (Eigen::Index i = 0; i < n; i++) {
+                        glm::vec3 f = Fixed[i] ? glm::vec3(0) : glm::vec3(0, -Gravity, 0) * Mass - Damping * inst.Velocities[i] + inst.Forces[i];
+                        glm::vec3 const y = inst.Positions[i] + (inst.Velocities[i] + dt * f / Mass) * dt;
+                        inst.Forces[i]    = glm::vec3(0);
+                        for (int d = 0; d < 3; d++) {
+                            InstanceStart(i, 3 * k + d)   = inst.Positions[i][d];
+                            InstanceTargets(i, 3 * k + d) = y[d];
+                        }
+                    }
+                }
+
+                for (int it = 0; it < MaxIterations; it++) {
+                    // local steps, one instance after the other
+                    for (std::size_t k = b; k < e; k++) {
+                        auto & inst = instances[k];
+                        for_each_worker_batch([&](auto & batch) {
+                            if (! batch.Active()) return;
+                            batch.Load(inst.Positions, 0, batch.Size());
+                            batch.Project(0, batch.Size());
+                        });
+                        for (Eigen::Index i = 0; i < n; i++) {
+                            glm::vec3 f(0);
+                            if (! Fixed[i]) {
+                                for_each_worker_batch([&](auto const & batch) {
+                                    if (batch.Active()) batch.Gather(std::size_t(i), f);
+                                });
+                            }
+                            for (int d = 0; d < 3; d++) {
+                                float const diff            = Fixed[i] ? 0.f : InstanceTargets(i, 3 * k + d) - inst.Positions[i][d];
+                                InstanceRhs(i, 3 * k + d) = Mass * diff / dt / dt + f[d];
+                            }
+                        }
+                    }
+
+                    // one global solve for the block of the range
+                    if (Global == GlobalSolve::Jacobi) jacobi_solve(InstanceRhs.middleCols(col, cols), worker);
+                    else solve_pinned(InstanceRhs.middleCols(col, cols), worker);
+
+                    float update = 0;
+                    for (std::size_t k = b; k < e; k++) {
+                        auto & inst = instances[k];
+                        for (Eigen::Index i = 0; i < n; i++)
+                            inst.Positions[i] += glm::vec3(InstanceRhs(i, 3 * k), InstanceRhs(i, 3 * k + 1), InstanceRhs(i, 3 * k + 2));
+                        update = std::max(update, InstanceRhs.middleCols(Eigen::Index(3 * k), 3).norm() / std::sqrt(float(std::max<Eigen::Index>(n, 1))));
+                    }
+                    worker.Iterations = it + 1;
+                    worker.Update     = update;
+                    if (update <= Tolerance) break;
+                }
+
+                for (std::size_t k = b; k < e; k++) {
+                    auto & inst = instances[k];
+                    for (Eigen::Index i = 0; i < n; i++)
+                        inst.Velocities[i] = (inst.Positions[i] - glm::vec3(InstanceStart(i, 3 * k), InstanceStart(i, 3 * k + 1), InstanceStart(i, 3 * k + 2))) / dt;
+                }
+            });
+            LastIterations = 0;
+            LastUpdateNorm = 0;
+            for (auto const & worker : InstanceWorkers) {
+                LastIterations = std::max(LastIterations, worker.Iterations);
+                LastUpdateNorm = std::max(LastUpdateNorm, worker.Update);
+            }
+        }
     };
 } // namespace VCX::Labs::GettingStarted
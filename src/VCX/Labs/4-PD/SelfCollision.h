@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Labs/Common/Parallel.h"
+
+namespace VCX::Labs::PD {
+    // Self-collision of a triangle mesh as a pass after the PD iterations. A step moves every
+    // particle from start to end along a straight line. Vertex-triangle and edge-edge pairs whose
+    // swept boxes overlap are found through a uniform spatial hash over the triangles, and tested by
+    // continuous collision detection (the roots of the coplanarity cubic) plus a proximity test at
+    // the end of the step. Every contact then becomes a one-sided constraint n . sum w_i x_i >= Thickness
+    // on the side the pair was on at the start, projected Jacobi-style a few passes. The hash tables are
+    // sized with the mesh and only refilled each step, the contact lists keep their capacity.
+    class SelfCollision {
+    public:
+        float Thickness { .01f };
+        int   Passes { 8 };
+        int   LastContacts { 0 };
+
+        void SetMesh(std::size_t const particles, std::vector<std::array<int, 3>> const & triangles, std::vector<glm::vec3> const & positions) {
+            _triangles = triangles;
+            _edges.clear();
+            _triangleEdges.resize(triangles.size());
+            _edgeOwner.clear();
+            // unique edges, each owned by the first triangle that lists it
+            std::vector<std::array<int, 3>> keys; // (lo, hi, triangle * 3 + side)
+            for (std::size_t t = 0; t < triangles.size(); t++)
+                for (int k = 0; k < 3; k++) {
+                    int const a = triangles[t][k], b = triangles[t][(k + 1) % 3];
+                    keys.push_back({ std::min(a, b), std::max(a, b), int(t * 3 + k) });
+                }
+            std::sort(keys.begin(), keys.end());
+            float length = 0;
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                if (i == 0 || keys[i][0] != keys[i - 1][0] || keys[i][1] != keys[i - 1][1]) {
+                    _edges.push_back({ keys[i][0], keys[i][1] });
+                    _edgeOwner.push_back(keys[i][2] / 3);
+                    length += glm::length(positions[keys[i][0]] - positions[keys[i][1]]);
+                }
+                _triangleEdges[keys[i][2] / 3][keys[i][2] % 3] = int(_edges.size() - 1);
+            }
+            _meanEdge = _edges.empty() ? 1 : length / _edges.size();
+            _cellSize = _meanEdge;
+
+            std::size_t size = 1;
+            while (size < 2 * triangles.size()) size <<= 1;
+            _tableMask = size - 1;
+            _cellStart.resize(size + 1);
+            _cellCursor.resize(size);
+            _boxLo.resize(triangles.size());
+            _boxHi.resize(triangles.size());
+            _cellLo.resize(triangles.size());
+            _cellHi.resize(triangles.size());
+            _inverseMass.resize(particles);
+            _correction.resize(particles);
+            _count.resize(particles);
+        }
+
+        // mean rest length of the mesh edges; a Thickness above it makes neighbouring vertices contacts
+        float MeanEdgeLength() const { return _meanEdge; }
+
+        // Moves end so that no pair crosses between start and end. Returns the number of contacts.
+        int Resolve(std::vector<glm::vec3> const & start, std::vector<glm::vec3> & end, std::vector<int> const & fixed) {
+            LastContacts = 0;
+            if (_triangles.empty()) return 0;
+            _cellSize = std::max(_cellSize, 2 * Thickness);
+            for (std::size_t i = 0; i < end.size(); i++) _inverseMass[i] = fixed[i] ? 0.f : 1.f;
+            for (int pass = 0; pass < Passes; pass++) {
+                build_hash(start, end);
+                int const contacts = find_contacts(start, end);
+                if (pass == 0) LastContacts = contacts;
+                if (contacts == 0) break;
+                apply_contacts(end);
+            }
+            return LastContacts;
+        }
+
+    private:
+        struct Contact {
+            std::array<int, 4>   Particles;
+            std::array<float, 4> Weights;
+            glm::vec3            Normal;
+        };
+
+        std::vector<std::array<int, 3>> _triangles;
+        std::vector<std::array<int, 2>> _edges;
+        std::vector<std::array<int, 3>> _triangleEdges;
+        std::vector<int>                _edgeOwner;
+        float                           _cellSize { 1 };
+        float                           _meanEdge { 1 };
+
+        std::size_t            _tableMask { 0 };
+        std::vector<int>       _cellStart, _cellCursor, _cellEntries;
+        std::vector<glm::vec3> _boxLo, _boxHi;
+        std::vector<glm::ivec3> _cellLo, _cellHi;
+
+        std::vector<std::vector<Contact>> _contacts; // one list per chunk of the parallel search
+        std::vector<float>                _inverseMass;
+        std::vector<glm::vec3>            _correction;
+        std::vector<int>                  _count;
+
+        glm::ivec3 cell_of(glm::vec3 const & p) const { return glm::ivec3(glm::floor(p / _cellSize)); }
+
+        std::size_t hash(int const i, int const j, int const k) const {
+            return (std::uint32_t(i) * 73856093u ^ std::uint32_t(j) * 19349663u ^ std::uint32_t(k) * 83492791u) & _tableMask;
+        }
+
+        // swept boxes of the triangles, inflated by the thickness, binned by a counting sort
+        void build_hash(std::vector<glm::vec3> const & start, std::vector<glm::vec3> const & end) {
+            Common::ParallelFor(0, _triangles.size(), [&](std::size_t const t) {
+                glm::vec3 lo(start[_triangles[t][0]]), hi(lo);
+                for (int const p : _triangles[t]) {
+                    lo = glm::min(lo, glm::min(start[p], end[p]));
+                    hi = glm::max(hi, glm::max(start[p], end[p]));
+                }
+                _boxLo[t]  = lo - Thickness;
+                _boxHi[t]  = hi + Thickness;
+                _cellLo[t] = cell_of(_boxLo[t]);
+                _cellHi[t] = cell_of(_boxHi[t]);
+            }, 1024);
+            std::fill(_cellStart.begin(), _cellStart.end(), 0);
+            for (std::size_t t = 0; t < _triangles.size(); t++)
+                for_cells(_cellLo[t], _cellHi[t], [&](int const i, int const j, int const k) { _cellStart[hash(i, j, k) + 1]++; });
+            for (std::size_t c = 0; c + 1 < _cellStart.size(); c++) _cellStart[c + 1] += _cellStart[c];
+            _cellEntries.resize(_cellStart.back());
+            std::copy(_cellStart.begin(), _cellStart.end() - 1, _cellCursor.begin());
+            for (std::size_t t = 0; t < _triangles.size(); t++)
+                for_cells(_cellLo[t], _cellHi[t], [&](int const i, int const j, int const k) { _cellEntries[_cellCursor[hash(i, j, k)]++] = int(t); });
+        }
+
+        template<typename Func>
+        static void for_cells(glm::ivec3 const & lo, glm::ivec3 const & hi, Func && func) {
+            for (int i = lo.x; i <= hi.x; i++)
+                for (int j = lo.y; j <= hi.y; j++)
+                    for (int k = lo.z; k <= hi.z; k++) func(i, j, k);
+        }
+
+        // Calls func(t) once for every triangle whose box overlaps [lo, hi]: a pair met in several
+        // cells is only reported in the first cell both of them cover.
+        template<typename Func>
+        void for_triangles(glm::vec3 const & lo, glm::vec3 const & hi, Func && func) const {
+            glm::ivec3 const cLo = cell_of(lo), cHi = cell_of(hi);
+            for_cells(cLo, cHi, [&](int const i, int const j, int const k) {
+                std::size_t const h = hash(i, j, k);
+                for (int e = _cellStart[h]; e < _cellStart[h + 1]; e++) {
+                    int const t = _cellEntries[e];
+                    if (glm::any(glm::lessThan(hi, _boxLo[t])) || glm::any(glm::greaterThan(lo, _boxHi[t]))) continue;
+                    if (glm::ivec3(i, j, k) != glm::max(cLo, _cellLo[t])) continue;
+                    func(t);
+                }
+            });
+        }
+
+        // Roots in [0, 1] of the cubic (a(t) x b(t)) . c(t) for vectors moving linearly from *0 to *1,
+        // ascending. These are the times at which four points become coplanar.
+        static int coplanar_times(glm::vec3 const & a0, glm::vec3 const & a1, glm::vec3 const & b0, glm::vec3 const & b1, glm::vec3 const & c0, glm::vec3 const & c1, std::array<float, 3> & roots) {
+            glm::vec3 const av = a1 - a0, bv = b1 - b0, cv = c1 - c0;
+            glm::vec3 const A = glm::cross(a0, b0), B = glm::cross(a0, bv) + glm::cross(av, b0), C = glm::cross(av, bv);
+            float const     k0 = glm::dot(A, c0), k1 = glm::dot(A, cv) + glm::dot(B, c0), k2 = glm::dot(B, cv) + glm::dot(C, c0), k3 = glm::dot(C, cv);
+            auto const      f  = [&](float const t) { return ((k3 * t + k2) * t + k1) * t + k0; };
+            // split [0, 1] at the extrema, then bisect every monotone piece with a sign change
+            std::array<float, 4> knots { 0, 1, 1, 1 };
+            int                  nKnots = 1;
+            float const          qa = 3 * k3, qb = 2 * k2, qc = k1;
+            if (std::abs(qa) > 1e-20f) {
+                float const disc = qb * qb - 4 * qa * qc;
+                if (disc >= 0) {
+                    float const s = std::sqrt(disc);
+                    for (float const t : { (-qb - s) / (2 * qa), (-qb + s) / (2 * qa) })
+                        if (t > 0 && t < 1) knots[nKnots++] = t;
+                }
+            } else if (std::abs(qb) > 1e-20f) {
+                float const t = -qc / qb;
+                if (t > 0 && t < 1) knots[nKnots++] = t;
+            }
+            std::sort(knots.begin() + 1, knots.begin() + nKnots);
+            knots[nKnots++] = 1;
+            int count = 0;
+            for (int piece = 0; piece + 1 < nKnots && count < 3; piece++) {
+                float lo = knots[piece], hi = knots[piece + 1];
+                float flo = f(lo), fhi = f(hi);
+                if (flo == 0) {
+                    if (count == 0 || roots[count - 1] != lo) roots[count++] = lo;
+                    continue;
+                }
+                if ((flo < 0) == (fhi < 0)) continue;
+                for (int it = 0; it < 30; it++) {
+                    float const mid = .5f * (lo + hi), fm = f(mid);
+                    if ((fm < 0) == (flo < 0)) {
+                        lo  = mid;
+                        flo = fm;
+                    } else hi = mid;
+                }
+                roots[count++] = .5f * (lo + hi);
+            }
+            return count;
+        }
+
+        // barycentric coordinates of the point of the triangle's plane closest to p
+        static glm::vec3 barycentric(glm::vec3 const & p, glm::vec3 const & x0, glm::vec3 const & x1, glm::vec3 const & x2) {
+            glm::vec3 const e1 = x1 - x0, e2 = x2 - x0, d = p - x0;
+            float const     d11 = glm::dot(e1, e1), d12 = glm::dot(e1, e2), d22 = glm::dot(e2, e2);
+            float const     det = d11 * d22 - d12 * d12;
+            if (det <= 0) return glm::vec3(-1);
+            float const u = (d22 * glm::dot(d, e1) - d12 * glm::dot(d, e2)) / det;
+            float const v = (d11 * glm::dot(d, e2) - d12 * glm::dot(d, e1)) / det;
+            return glm::vec3(1 - u - v, u, v);
+        }
+
+        // parameters of the closest points of the segments p0 p1 and q0 q1
+        static glm::vec2 closest_parameters(glm::vec3 const & p0, glm::vec3 const & p1, glm::vec3 const & q0, glm::vec3 const & q1) {
+            glm::vec3 const d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+            float const     a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+            float const     c = glm::dot(d1, r), b = glm::dot(d1, d2);
+            float const     denom = a * e - b * b;
+            float           s     = denom > 1e-12f * a * e ? std::clamp((b * f - c * e) / denom, 0.f, 1.f) : 0.f;
+            float           t     = e > 0 ? (b * s + f) / e : 0.f;
+            if (t < 0) {
+                t = 0;
+                s = a > 0 ? std::clamp(-c / a, 0.f, 1.f) : 0.f;
+            } else if (t > 1) {
+                t = 1;
+                s = a > 0 ? std::clamp((b - c) / a, 0.f, 1.f) : 0.f;
+            }
+            return glm::vec2(s, t);
+        }
+
+        bool vertex_triangle(int const p, int const t, std::vector<glm::vec3> const & start, std::vector<glm::vec3> const & end, Contact & contact) const {
+            auto const &    tri = _triangles[t];
+            glm::vec3 const a0 = start[tri[0]], b0 = start[tri[1]], c0 = start[tri[2]], p0 = start[p];
+            glm::vec3 const a1 = end[tri[0]], b1 = end[tri[1]], c1 = end[tri[2]], p1 = end[p];
+            glm::vec3 const n1 = glm::cross(b1 - a1, c1 - a1);
+            float const     n1Length = glm::length(n1);
+            if (n1Length <= 0) return false;
+            // barycentric slack of about one thickness, capped so that it never reaches the next
+            // vertex over, which sits at a coordinate of -1 and lies in the plane of flat cloth
+            float const tolerance = std::min(Thickness / std::sqrt(n1Length), .25f);
+
+            bool                 hit = false;
+            std::array<float, 3> roots;
+            int const            nRoots = coplanar_times(b0 - a0, b1 - a1, c0 - a0, c1 - a1, p0 - a0, p1 - a1, roots);
+            for (int r = 0; r < nRoots && ! hit; r++) {
+                float const     time = roots[r];
+                glm::vec3 const w    = barycentric(glm::mix(p0, p1, time), glm::mix(a0, a1, time), glm::mix(b0, b1, time), glm::mix(c0, c1, time));
+                hit                = glm::all(glm::greaterThanEqual(w, glm::vec3(-tolerance)));
+            }
+            glm::vec3 const normal = n1 / n1Length;
+            glm::vec3       w      = barycentric(p1, a1, b1, c1);
+            if (! hit) hit = std::abs(glm::dot(p1 - a1, normal)) < Thickness && glm::all(glm::greaterThanEqual(w, glm::vec3(-tolerance)));
+            if (! hit) return false;
+
+            // the side at the start of the step decides the direction of the push
+            glm::vec3 const n0   = glm::cross(b0 - a0, c0 - a0);
+            float const     side = glm::dot(p0 - a0, n0) >= 0 ? 1.f : -1.f;
+            w                    = glm::max(w, glm::vec3(0));
+            w /= w.x + w.y + w.z;
+            contact.Particles = { p, tri[0], tri[1], tri[2] };
+            contact.Weights   = { 1, -w.x, -w.y, -w.z };
+            contact.Normal    = side * normal;
+            return separation(contact, end) < Thickness;
+        }
+
+        bool edge_edge(int const ea, int const eb, std::vector<glm::vec3> const & start, std::vector<glm::vec3> const & end, Contact & contact) const {
+            int const       i0 = _edges[ea][0], i1 = _edges[ea][1];
+            int const       j0 = _edges[eb][0], j1 = _edges[eb][1];
+            glm::vec3 const p0 = start[i0], p1 = start[i1], q0 = start[j0], q1 = start[j1];
+            glm::vec3 const P0 = end[i0], P1 = end[i1], Q0 = end[j0], Q1 = end[j1];
+
+            bool                 hit = false;
+            std::array<float, 3> roots;
+            int const            nRoots = coplanar_times(p1 - p0, P1 - P0, q1 - q0, Q1 - Q0, q0 - p0, Q0 - P0, roots);
+            for (int r = 0; r < nRoots && ! hit; r++) {
+                float const     t  = roots[r];
+                glm::vec3 const a0 = glm::mix(p0, P0, t), a1 = glm::mix(p1, P1, t), b0 = glm::mix(q0, Q0, t), b1 = glm::mix(q1, Q1, t);
+                glm::vec2 const st = closest_parameters(a0, a1, b0, b1);
+                hit                = glm::length(glm::mix(a0, a1, st.x) - glm::mix(b0, b1, st.y)) < .1f * Thickness;
+            }
+            glm::vec2 const st  = closest_parameters(P0, P1, Q0, Q1);
+            glm::vec3 const gap = glm::mix(Q0, Q1, st.y) - glm::mix(P0, P1, st.x);
+            // endpoints are the business of the vertex-triangle tests
+            if (! hit) hit = glm::length(gap) < Thickness && st.x > 0 && st.x < 1 && st.y > 0 && st.y < 1;
+            if (! hit) return false;
+
+            glm::vec2 const st0     = closest_parameters(p0, p1, q0, q1);
+            glm::vec3 const gap0    = glm::mix(q0, q1, st0.y) - glm::mix(p0, p1, st0.x);
+            glm::vec3       normal  = glm::cross(P1 - P0, Q1 - Q0);
+            float const     nLength = glm::length(normal);
+            if (nLength > 1e-12f) normal /= nLength;
+            else if (glm::length(gap0) > 0) normal = glm::normalize(gap0);
+            else return false;
+            if (glm::dot(normal, gap0) < 0) normal = -normal;
+            contact.Particles = { i0, i1, j0, j1 };
+            contact.Weights   = { st.x - 1, -st.x, 1 - st.y, st.y };
+            contact.Normal    = normal;
+            return separation(contact, end) < Thickness;
+        }
+
+        static float separation(Contact const & contact, std::vector<glm::vec3> const & x) {
+            glm::vec3 d(0);
+            for (int k = 0; k < 4; k++) d += contact.Weights[k] * x[contact.Particles[k]];
+            return glm::dot(contact.Normal, d);
+        }
+
+        int find_contacts(std::vector<glm::vec3> const & start, std::vector<glm::vec3> const & end) {
+            auto &            pool    = Common::ThreadPool::Instance();
+            std::size_t const nChunks = pool.ChunkCount(end.size() + _edges.size(), 512);
+            if (_contacts.size() < nChunks) _contacts.resize(nChunks);
+            for (auto & list : _contacts) list.clear();
+            std::size_t const nVertices = end.size();
+            // one index range over the vertices, then the edges
+            pool.ForChunks(0, nVertices + _edges.size(), nChunks, [&](std::size_t const chunk, std::size_t const b, std::size_t const e) {
+                auto &  list = _contacts[chunk];
+                Contact contact;
+                for (std::size_t i = b; i < e; i++) {
+                    if (i < nVertices) {
+                        int const       p  = int(i);
+                        glm::vec3 const lo = glm::min(start[p], end[p]) - Thickness, hi = glm::max(start[p], end[p]) + Thickness;
+                        for_triangles(lo, hi, [&](int const t) {
+                            auto const & tri = _triangles[t];
+                            if (tri[0] == p || tri[1] == p || tri[2] == p) return;
+                            if (_inverseMass[p] + _inverseMass[tri[0]] + _inverseMass[tri[1]] + _inverseMass[tri[2]] == 0) return;
+                            if (vertex_triangle(p, t, start, end, contact)) list.push_back(contact);
+                        });
+                    } else {
+                        int const       ea = int(i - nVertices);
+                        int const       i0 = _edges[ea][0], i1 = _edges[ea][1];
+                        glm::vec3 const lo = glm::min(glm::min(start[i0], end[i0]), glm::min(start[i1], end[i1])) - Thickness;
+                        glm::vec3 const hi = glm::max(glm::max(start[i0], end[i0]), glm::max(start[i1], end[i1])) + Thickness;
+                        for_triangles(lo, hi, [&](int const t) {
+                            for (int const eb : _triangleEdges[t]) {
+                                if (eb <= ea || _edgeOwner[eb] != t) continue;
+                                int const j0 = _edges[eb][0], j1 = _edges[eb][1];
+                                if (j0 == i0 || j0 == i1 || j1 == i0 || j1 == i1) continue;
+                                if (edge_edge(ea, eb, start, end, contact)) list.push_back(contact);
+                            }
+                        });
+                    }
+                }
+            });
+            int total = 0;
+            for (auto const & list : _contacts) total += int(list.size());
+            return total;
+        }
+
+        // every contact projects onto its constraint as if alone, the particles average the moves
+        void apply_contacts(std::vector<glm::vec3> & end) {
+            std::fill(_correction.begin(), _correction.end(), glm::vec3(0));
+            std::fill(_count.begin(), _count.end(), 0);
+            for (auto const & list : _contacts) {
+                for (auto const & contact : list) {
+                    float denom = 0;
+                    for (int k = 0; k < 4; k++) denom += contact.Weights[k] * contact.Weights[k] * _inverseMass[contact.Particles[k]];
+                    if (denom <= 0) continue;
+                    float const lambda = (Thickness - separation(contact, end)) / denom;
+                    if (lambda <= 0) continue;
+                    for (int k = 0; k < 4; k++) {
+                        int const p = contact.Particles[k];
+                        if (_inverseMass[p] == 0) continue;
+                        _correction[p] += _inverseMass[p] * contact.Weights[k] * lambda * contact.Normal;
+                        _count[p]++;
+                    }
+                }
+            }
+            Common::ParallelFor(0, end.size(), [&](std::size_t const i) {
+                if (_count[i] > 0) end[i] += _correction[i] / float(_count[i]);
+            }, 4096);
+        }
+    };
+} // namespace VCX::Labs::PD
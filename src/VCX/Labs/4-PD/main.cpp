@@ -1,8 +1,15 @@
+#include <string_view>
+#include <vector>
+
 #include "Assets/bundled.h"
 #include "Labs/4-PD/App.h"
+#include "Labs/4-PD/ClothScene.h"
 
-int main() {    
+int main(int argc, char ** argv) {
     using namespace VCX;
+    // lab4 --benchmark [64 256 1024] steps the cloth presets without opening a window
+    if (argc > 1 && std::string_view(argv[1]) == "--benchmark")
+        return Labs::PD::RunClothBenchmarks(std::vector<std::string_view>(argv + 2, argv + argc));
     return Engine::RunApp<Labs::PD::App>(Engine::AppContextOptions {
         .Title         = "VCX-sim Labs 4: Projective Dynamics",
         .WindowSize    = {1024, 768},
@@ -0,0 +1,99 @@
+// Steps the default cloth with every combination of global solve and acceleration and checks that
+// a step allocates nothing once the first one has sized the workspace. Plain allocations are
+// counted by replacing the global operator new; Eigen's dense storage goes through malloc, so it
+// is caught by Eigen's runtime no-malloc check, which reports through eigen_assert. Only that check
+// is counted, any other failed Eigen assertion aborts as usual.
+//
+//     xmake build lab4-allocation-count && xmake run lab4-allocation-count
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+    std::atomic<long> g_Allocations { 0 };
+    std::atomic<long> g_EigenAllocations { 0 };
+
+    void EigenAssertFailed(char const * const expression, char const * const file, int const line) {
+        if (std::strstr(expression, "EIGEN_RUNTIME_NO_MALLOC")) {
+            g_EigenAllocations++;
+            return;
+        }
+        std::fprintf(stderr, "%s:%d: Eigen assertion failed: %s\n", file, line, expression);
+        std::abort();
+    }
+} // namespace
+
+#define EIGEN_RUNTIME_NO_MALLOC
+#define eigen_assert(x) ((x) ? void(0) : EigenAssertFailed(#x, __FILE__, __LINE__))
+
+void * operator new(std::size_t const size) {
+    g_Allocations++;
+    if (void * const p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t const size) {
+    g_Allocations++;
+    if (void * const p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * const p) noexcept { std::free(p); }
+void operator delete[](void * const p) noexcept { std::free(p); }
+void operator delete(void * const p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void * const p, std::size_t) noexcept { std::free(p); }
+
+#include <spdlog/spdlog.h>
+
+#include "Labs/4-PD/ClothScene.h"
+
+int main() {
+    using namespace VCX::Labs::PD;
+    using GlobalSolve  = MassSpringSystem::GlobalSolve;
+    using Acceleration = MassSpringSystem::Acceleration;
+
+    constexpr int   c_Steps = 20;
+    constexpr float c_Dt    = 1.f / 60;
+
+    int failures = 0;
+    for (auto const global : { GlobalSolve::Cholesky, GlobalSolve::Jacobi }) {
+        for (auto const accel : { Acceleration::None, Acceleration::Chebyshev, Acceleration::Anderson }) {
+            for (bool const pinChange : { false, true }) {
+                MassSpringSystem system;
+                system.Stiffness           = 1000;
+                system.BendingStiffness    = 10;
+                system.StrainStiffness     = 100;
+                system.EnableSelfCollision = true;
+                system.Global              = global;
+                system.Accel               = accel;
+                system.Tolerance           = 0; // always run MaxIterations
+                BuildCloth(system, ClothOptions {});
+
+                system.AdvanceMassSpringSystem(c_Dt);
+                if (pinChange) {
+                    // pin a particle in the middle and release a corner, corrected without refactoring
+                    system.Fixed[system.Positions.size() / 2] = true;
+                    system.Fixed[0]                           = false;
+                    system.AdvanceMassSpringSystem(c_Dt);
+                }
+
+                long const before = g_Allocations;
+                g_EigenAllocations = 0;
+                Eigen::internal::set_is_malloc_allowed(false);
+                for (int k = 0; k < c_Steps; k++) system.AdvanceMassSpringSystem(c_Dt);
+                Eigen::internal::set_is_malloc_allowed(true);
+                long const allocations = g_Allocations - before;
+                long const eigen       = g_EigenAllocations;
+
+                bool const ok = allocations == 0 && eigen == 0;
+                if (! ok) failures++;
+                spdlog::info("global {} accel {} pin change {}: {} allocations, {} Eigen allocations in {} steps{}",
+                    int(global), int(accel), pinChange, allocations, eigen, c_Steps, ok ? "" : "  FAILED");
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -95,6 +95,7 @@ namespace VCX::Labs::Common {
         float heightNorm = 1.f / window->Rect().GetHeight();
 
         bool applyingForce = moving && altKey && leftHeld;
+        _holding = altKey && leftHeld;
 
         if (applyingForce) {
             glm::vec3 direction = camera.Target - camera.Eye;
@@ -17,9 +17,11 @@ namespace VCX::Labs::Common {
         glm::vec3 getForce();
         std::pair<glm::vec3,glm::vec3> getForce(glm::vec3 cubeCenter);  // force with applied point, return force + point
         std::pair<glm::vec3,int> getForce(std::vector<glm::vec3> candidatePoints);
+        bool IsHolding() const { return _holding; } // alt and the left button are down, also while the mouse rests
 
     private:
         glm::vec3 _forceDelta = glm::vec3(0.f);
+        bool _holding = false;
         Engine::Camera _camera;
         glm::vec3 _rayDirection = glm::vec3(0.f);
     };
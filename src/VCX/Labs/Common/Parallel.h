@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VCX::Labs::Common {
+    // A fixed set of worker threads shared by all simulators. Work is handed out as contiguous
+    // chunks of an index range; the calling thread takes part and blocks until every chunk is done.
+    class ThreadPool {
+    public:
+        static ThreadPool & Instance() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        ThreadPool(ThreadPool const &)             = delete;
+        ThreadPool & operator=(ThreadPool const &) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            for (auto & worker : _workers) worker.join();
+        }
+
+        std::size_t Concurrency() const { return _workers.size() + 1; }
+
+        // func(chunk, begin, end) is called once per chunk.
+        template<typename Func>
+        void ForChunks(std::size_t const begin, std::size_t const end, std::size_t const nChunks, Func && func) {
+            if (end <= begin) return;
+            if (nChunks <= 1 || _workers.empty()) {
+                func(std::size_t(0), begin, end);
+                return;
+            }
+            struct Context {
+                Func *      F;
+                std::size_t Begin;
+                std::size_t Count;
+                std::size_t NChunks;
+            } const ctx { &func, begin, end - begin, nChunks };
+            Run(
+                [](void const * p, std::size_t const k) {
+                    auto const & c = *static_cast<Context const *>(p);
+                    (*c.F)(k, c.Begin + c.Count * k / c.NChunks, c.Begin + c.Count * (k + 1) / c.NChunks);
+                },
+                &ctx,
+                nChunks);
+        }
+
+        std::size_t ChunkCount(std::size_t const count, std::size_t const grain) const {
+            return std::max<std::size_t>(1, std::min(Concurrency() * 4, (count + grain - 1) / grain));
+        }
+
+    private:
+        using Invoke = void (*)(void const *, std::size_t);
+
+        std::vector<std::thread> _workers;
+        std::mutex               _mutex;
+        std::condition_variable  _wake;
+        std::condition_variable  _done;
+        std::atomic<std::size_t> _next { 0 };
+        std::atomic<std::size_t> _pending { 0 };
+        std::size_t              _nChunks { 0 };
+        std::size_t              _generation { 0 };
+        std::size_t              _active { 0 };
+        Invoke                   _invoke { nullptr };
+        void const *             _ctx { nullptr };
+        bool                     _stop { false };
+
+        ThreadPool() {
+            unsigned const n = std::thread::hardware_concurrency();
+            for (unsigned i = 1; i < n; i++) _workers.emplace_back([this] { WorkerLoop(); });
+        }
+
+        void Work(Invoke const invoke, void const * ctx, std::size_t const nChunks) {
+            std::size_t k;
+            while ((k = _next.fetch_add(1)) < nChunks) {
+                invoke(ctx, k);
+                if (_pending.fetch_sub(1) == 1) {
+                    std::lock_guard lock(_mutex);
+                    _done.notify_all();
+                }
+            }
+        }
+
+        void WorkerLoop() {
+            std::size_t seen = 0;
+            while (true) {
+                std::unique_lock lock(_mutex);
+                _wake.wait(lock, [&] { return _stop || _generation != seen; });
+                if (_stop) return;
+                seen                 = _generation;
+                Invoke const invoke  = _invoke;
+                void const * ctx     = _ctx;
+                std::size_t  nChunks = _nChunks;
+                _active++;
+                lock.unlock();
+                Work(invoke, ctx, nChunks);
+                lock.lock();
+                if (--_active == 0) _done.notify_all();
+            }
+        }
+
+        void Run(Invoke const invoke, void const * ctx, std::size_t const nChunks) {
+            std::unique_lock lock(_mutex);
+            // a late worker may still be draining the previous job
+            _done.wait(lock, [&] { return _active == 0; });
+            _invoke  = invoke;
+            _ctx     = ctx;
+            _nChunks = nChunks;
+            _next    = 0;
+            _pending = nChunks;
+            _generation++;
+            lock.unlock();
+            _wake.notify_all();
+            Work(invoke, ctx, nChunks);
+            lock.lock();
+            _done.wait(lock, [&] { return _pending == 0 && _active == 0; });
+        }
+    };
+
+    // Calls func(i) for every i in [begin, end), split across the shared thread pool.
+    template<typename Func>
+    void ParallelFor(std::size_t const begin, std::size_t const end, Func && func, std::size_t const grain = 256) {
+        auto & pool = ThreadPool::Instance();
+        pool.ForChunks(begin, end, pool.ChunkCount(end - begin, grain), [&](std::size_t, std::size_t const b, std::size_t const e) {
+            for (std::size_t i = b; i < e; i++) func(i);
+        });
+    }
+
+    // Calls func(b, e) on contiguous blocks of [begin, end), for kernels that vectorize over a block.
+    template<typename Func>
+    void ParallelForBlocks(std::size_t const begin, std::size_t const end, Func && func, std::size_t const grain = 1024) {
+        auto & pool = ThreadPool::Instance();
+        pool.ForChunks(begin, end, pool.ChunkCount(end - begin, grain), [&](std::size_t, std::size_t const b, std::size_t const e) {
+            func(b, e);
+        });
+    }
+
+    // Sums func(i) over [begin, end) with one partial sum per chunk, combined in a fixed order.
+    template<typename T, typename Func>
+    T ParallelSum(std::size_t const begin, std::size_t const end, T const init, Func && func, std::size_t const grain = 1024) {
+        constexpr std::size_t c_MaxChunks = 64;
+        auto &                pool        = ThreadPool::Instance();
+        std::size_t const     nChunks     = std::min(c_MaxChunks, pool.ChunkCount(end - begin, grain));
+        std::array<T, c_MaxChunks> partial;
+        partial.fill(T(0));
+        pool.ForChunks(begin, end, nChunks, [&](std::size_t const k, std::size_t const b, std::size_t const e) {
+            T sum(0);
+            for (std::size_t i = b; i < e; i++) sum += func(i);
+            partial[k] = sum;
+        });
+        T result = init;
+        for (std::size_t k = 0; k < nChunks; k++) result += partial[k];
+        return result;
+    }
+} // namespace VCX::Labs::Common
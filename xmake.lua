@@ -141,6 +141,16 @@ target("lab4")
     add_headerfiles("src/VCX/Labs/4-PD/*.h")
     add_headerfiles("src/VCX/Labs/4-PD/*.hpp")
     add_files      ("src/VCX/Labs/4-PD/*.cpp")
+    if is_plat("windows") then
+        add_cxflags("/EHsc")
+    end
+
+target("lab4-allocation-count")
+    set_kind("binary")
+    add_deps("lab-common")
+    add_packages("eigen")
+    add_files      ("src/VCX/Labs/4-PD/ClothScene.cpp")
+    add_files      ("src/VCX/Labs/4-PD/tests/AllocationCount.cpp")
     if is_plat("windows") then
         add_cxflags("/EHsc")
     end
\ No newline at end of file